@@ -0,0 +1,307 @@
+#include "decode.h"
+
+#include <string.h>
+
+// `$reg` or literal value, like get_operand() in machine.c
+static operand_t decode_value(const char* token) {
+    operand_t operand = { OPERAND_IMM, 0, 0, 0, 0 };
+    if(token[0] == '$' && parse_reg(token + 1) >= 0) {
+        operand.kind = OPERAND_REG;
+        operand.reg = parse_reg(token + 1);
+    } else {
+        operand.value = atoi(token);
+    }
+    return operand;
+}
+
+static operand_t decode_reg(const char* token) {
+    operand_t operand = { OPERAND_NONE, 0, 0, 0, 0 };
+    if(parse_reg(token) >= 0) {
+        operand.kind = OPERAND_REG;
+        operand.reg = parse_reg(token);
+    }
+    return operand;
+}
+
+static operand_t decode_addr(const char* token) {
+    operand_t operand = { OPERAND_NONE, 0, 0, 0, 0 };
+    if(token[0] == '%') {
+        operand.kind = OPERAND_ADDR;
+        operand.value = atoi(token + 1);
+    }
+    return operand;
+}
+
+static operand_t decode_pair(const char* token, int is_indirect) {
+    operand_t operand = { OPERAND_NONE, 0, 0, 0, 0 };
+    int hi, lo, is_increment = 0;
+    if(is_indirect ? parse_indirect(token, &hi, &lo, &is_increment) == 0 : parse_reg_pair(token, &hi, &lo) == 0) {
+        operand.kind = OPERAND_PAIR;
+        operand.reg = hi;
+        operand.reg_lo = lo;
+        operand.is_increment = is_increment;
+    }
+    return operand;
+}
+
+static void decode_instruction(instruction_t* instruction, const char* line) {
+    char buf[MAX_LINE_LEN];
+    snprintf(buf, MAX_LINE_LEN, "%s", line);
+
+    char* line_contents[MAX_LINE_ELEMENTS];
+    uint32_t line_elem_counter = split_line(buf, line_contents, MAX_LINE_ELEMENTS);
+    for(uint32_t i = line_elem_counter; i < 4; ++i) {
+        line_contents[i] = "";
+    }
+
+    memset(instruction, 0, sizeof(instruction_t));
+    instruction->op = get_opcode(line_contents[0]);
+
+    switch(instruction->op) {
+        case OP_MOV: {
+            if(line_contents[1][0] == '[' || line_contents[2][0] == '[') {
+                // register-pair indirect load or store, memory to memory isn't supported
+                if(line_contents[2][0] == '[') {
+                    instruction->dst = decode_reg(line_contents[1]);
+                    instruction->src = decode_pair(line_contents[2], 1);
+                } else {
+                    instruction->dst = decode_pair(line_contents[1], 1);
+                    instruction->src = decode_value(line_contents[2]);
+                }
+                instruction->is_invalid = instruction->dst.kind == OPERAND_NONE || instruction->src.kind == OPERAND_NONE;
+                break;
+            }
+            instruction->src = decode_value(line_contents[2]);
+            instruction->dst = decode_reg(line_contents[1]);
+            if(instruction->dst.kind == OPERAND_NONE) {
+                instruction->dst = decode_addr(line_contents[1]);
+            }
+            instruction->is_invalid = instruction->dst.kind == OPERAND_NONE;
+            break;
+        }
+        case OP_CMP: {
+            // anything but two general purpose registers is a no-op, not an error
+            instruction->dst = decode_reg(line_contents[1]);
+            instruction->src = decode_reg(line_contents[2]);
+            break;
+        }
+        case OP_JMP:
+        case OP_JZ: {
+            instruction->dst.kind = OPERAND_IMM;
+            instruction->dst.value = atoi(line_contents[1]);
+            break;
+        }
+        case OP_LEA: {
+            instruction->dst = decode_pair(line_contents[1], 0);
+            instruction->src = decode_addr(line_contents[2]);
+            instruction->is_invalid = instruction->dst.kind == OPERAND_NONE || instruction->src.kind == OPERAND_NONE;
+            break;
+        }
+        case OP_POP:
+        case OP_PUSH: {
+            instruction->dst = decode_reg(line_contents[1]);
+            instruction->is_invalid = instruction->dst.kind == OPERAND_NONE;
+            break;
+        }
+        case OP_FILL:
+        case OP_COPY:
+        case OP_MCMP: {
+            instruction->dst = decode_addr(line_contents[1]);
+            instruction->src = instruction->op == OP_FILL ? decode_value(line_contents[2]) : decode_addr(line_contents[2]);
+            instruction->extra = decode_value(line_contents[3]);
+            instruction->is_invalid = line_elem_counter < 4 || instruction->dst.kind == OPERAND_NONE || instruction->src.kind == OPERAND_NONE;
+            break;
+        }
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV: {
+            instruction->src = decode_value(line_contents[2]);
+            instruction->dst = decode_reg(line_contents[1]);
+            instruction->is_invalid = instruction->dst.kind == OPERAND_NONE;
+            break;
+        }
+        default: break;
+    }
+}
+
+uint32_t decode_program(program_t* program, const machine_t* machine) {
+    uint32_t length = 0;
+    while(length < PROGRAM_MEM_CAPACITY && machine->program_memory[length] != NULL) {
+        ++length;
+    }
+
+    program->length = 0;
+    program->instructions = malloc((length ? length : 1) * sizeof(instruction_t));
+    if(program->instructions == NULL) {
+        fprintf(stderr, "[-] decode_program() : out of memory\n");
+        return 1;
+    }
+
+    for(uint32_t i = 0; i < length; ++i) {
+        decode_instruction(&program->instructions[i], machine->program_memory[i]);
+    }
+    program->length = length;
+    return 0;
+}
+
+void free_program(program_t* program) {
+    free(program->instructions);
+    program->instructions = NULL;
+    program->length = 0;
+}
+
+static uint32_t get_value(machine_t* machine, const operand_t* operand) {
+    return operand->kind == OPERAND_REG ? get_reg(machine, operand->reg) : operand->value;
+}
+
+void execute_decoded(machine_t* machine, const instruction_t* instruction) {
+    const operand_t* dst = &instruction->dst;
+
+    switch(instruction->op) {
+        case OP_MOV: {
+            if(instruction->is_invalid) {
+                raise_fault(machine, " [-] - invalid `mov` instruction arguments!");
+                machine->pc++;
+            } else if(dst->kind == OPERAND_REG && instruction->src.kind == OPERAND_PAIR) {
+                load_indirect(machine, dst->reg, instruction->src.reg, instruction->src.reg_lo, instruction->src.is_increment);
+            } else if(dst->kind == OPERAND_REG) {
+                store_to_reg(machine, dst->reg, get_value(machine, &instruction->src));
+            } else if(dst->kind == OPERAND_PAIR) {
+                store_indirect(machine, dst->reg, dst->reg_lo, get_value(machine, &instruction->src), dst->is_increment);
+            } else {
+                poke(machine, dst->value, get_value(machine, &instruction->src));
+            }
+            break;
+        }
+        case OP_CMP: {
+            compare_regs(machine, dst->kind == OPERAND_REG ? dst->reg : -1,
+                instruction->src.kind == OPERAND_REG ? instruction->src.reg : -1);
+            break;
+        }
+        case OP_JMP: jump(machine, dst->value); break;
+        case OP_JZ: jump_if_not_zero(machine, dst->value); break;
+        case OP_POP: {
+            if(instruction->is_invalid) {
+                raise_fault(machine, " [-](pop) invalid instruction argument! (register)");
+                machine->pc++;
+            } else {
+                pop_stack(machine, dst->reg);
+            }
+            break;
+        }
+        case OP_PUSH: {
+            if(instruction->is_invalid) {
+                raise_fault(machine, " [-](push) invalid instruction argument! (register)");
+                machine->pc++;
+            } else {
+                push_stack(machine, dst->reg);
+            }
+            break;
+        }
+        case OP_LEA: {
+            if(instruction->is_invalid) {
+                raise_fault(machine, " [-] - invalid `lea` instruction arguments!");
+                machine->pc++;
+            } else {
+                load_address(machine, dst->reg, dst->reg_lo, instruction->src.value);
+            }
+            break;
+        }
+        case OP_FILL:
+        case OP_COPY:
+        case OP_MCMP: {
+            if(instruction->is_invalid) {
+                raise_fault(machine, " [-] - invalid block instruction arguments!");
+                machine->pc++;
+            } else if(instruction->op == OP_FILL) {
+                fill_memory(machine, dst->value, get_value(machine, &instruction->src), get_value(machine, &instruction->extra));
+            } else if(instruction->op == OP_COPY) {
+                copy_memory(machine, dst->value, instruction->src.value, get_value(machine, &instruction->extra));
+            } else {
+                compare_memory(machine, dst->value, instruction->src.value, get_value(machine, &instruction->extra));
+            }
+            break;
+        }
+        case OP_NOP: no_op(machine); break;
+        case OP_HLT:
+        case OP_END: halt(machine); break;
+        case OP_ADD: {
+            if(instruction->is_invalid) {
+                raise_fault(machine, " [-](add) invalid instruction argument! (register)");
+                machine->pc++;
+            } else {
+                add_to_register(machine, dst->reg, get_value(machine, &instruction->src));
+            }
+            break;
+        }
+        case OP_SUB: {
+            if(instruction->is_invalid) {
+                raise_fault(machine, " [-](sub) invalid instruction argument! (register)");
+                machine->pc++;
+            } else {
+                sub_to_register(machine, dst->reg, get_value(machine, &instruction->src));
+            }
+            break;
+        }
+        case OP_MUL: {
+            if(instruction->is_invalid) {
+                raise_fault(machine, " [-](mul) invalid instruction argument! (register)");
+                machine->pc++;
+            } else {
+                mul_to_register(machine, dst->reg, get_value(machine, &instruction->src));
+            }
+            break;
+        }
+        case OP_DIV: {
+            if(instruction->is_invalid) {
+                raise_fault(machine, " [-](div) invalid instruction argument! (register)");
+                machine->pc++;
+            } else {
+                div_to_register(machine, dst->reg, get_value(machine, &instruction->src));
+            }
+            break;
+        }
+        default: {
+            raise_fault(machine, " [-] unknown instruction!");
+            machine->pc++;
+            return;
+        }
+    }
+
+    if(machine->is_verbose == 1) {
+        print_registers(machine);
+    }
+}
+
+STOP_REASON run_decoded(machine_t* machine, const program_t* program, uint64_t n_instructions) {
+    uint64_t executed = 0;
+    machine->is_stop_requested = 0;
+
+    while(1) {
+        if(machine->halt) {
+            return STOP_HALTED;
+        }
+        if(executed >= n_instructions) {
+            return STOP_BUDGET;
+        }
+        if(machine->pc >= program->length) {
+            raise_fault(machine, " [-] pc points outside of the program!");
+            return STOP_FAULT;
+        }
+
+        const instruction_t* instruction = &program->instructions[machine->pc];
+        execute_decoded(machine, instruction);
+        ++executed;
+
+        machine->cycles += cycle_costs[instruction->op];
+        machine->stats.instructions++;
+
+        if(machine->halt && machine->halt_callback != NULL) {
+            machine->halt_callback(machine, machine->halt_user_data);
+        }
+        if(machine->is_stop_requested) {
+            return STOP_FAULT;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+/*
+
+    decode.h - Pre-decoded programs
+
+    The string interpreter in machine.c tokenizes every line each time it runs it.
+    decode_program() does the tokenizing and operand parsing once and produces a
+    read-only program_t, which run_decoded() executes with the same semantics
+    (including faults) as run_for(). A decoded program holds no machine state, so
+    one copy can be shared by any number of machines and threads.
+
+    Pacing and statistics publishing are left to run_for(), run_decoded() only
+    counts instructions and cycles.
+
+*/
+
+#ifndef DECODE_H_
+#define DECODE_H_
+
+#include "machine.h"
+
+typedef enum OPERAND_KIND {
+    OPERAND_NONE,   // missing or not understood
+    OPERAND_REG,    // ax..dx, or $ax..$dx as a value
+    OPERAND_IMM,    // literal number
+    OPERAND_ADDR,   // %N memory address
+    OPERAND_PAIR    // hi:lo register pair, [hi:lo] / [hi:lo+] memory it points to
+} OPERAND_KIND;
+
+typedef struct operand {
+    uint8_t kind;
+    // register, high register of a pair
+    uint8_t reg;
+    uint8_t reg_lo;
+    uint8_t is_increment;
+    uint32_t value;
+} operand_t;
+
+typedef struct instruction {
+    uint8_t op;
+    // instruction arguments don't fit the opcode, executing it raises a fault
+    uint8_t is_invalid;
+    operand_t dst, src, extra;
+} instruction_t;
+
+typedef struct program {
+    instruction_t* instructions;
+    uint32_t length;
+} program_t;
+
+uint32_t decode_program(program_t* program, const machine_t* machine);
+void free_program(program_t* program);
+void execute_decoded(machine_t* machine, const instruction_t* instruction);
+STOP_REASON run_decoded(machine_t* machine, const program_t* program, uint64_t n_instructions);
+
+#endif
@@ -0,0 +1,545 @@
+/*
+    fuzz.c - Differential fuzzing of the execution engines
+
+    Generates random kyasm programs, with the odd malformed line that has to fault
+    and be skipped, and FUZZ_LANES initial states per program, runs
+    every state through the string interpreter (run_for), which is the reference,
+    and through every other engine, then compares registers, flags, memory, stack,
+    error counts, stop reasons and statistics. Runs are cut off after an
+    instruction budget. The first mismatch is minimized and printed, a case is
+    reproduced with `kyfuzz -s <seed> -n 1`.
+
+    Usage: kyfuzz [-n <programs>] [-s <seed>] [-b <budget>] [-l <lines>] [-t <seconds>]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "machine.h"
+#include "decode.h"
+#include "simd.h"
+
+#define FUZZ_LANES SIMD_LANES
+#define MAX_FUZZ_LINES 64
+#define FUZZ_LINE_LEN 48
+// programs mostly address the first FUZZ_MEMORY bytes, states seed them
+#define FUZZ_MEMORY 64
+// values seeded at the bottom of the stack
+#define FUZZ_STACK 8
+#define DEFAULT_PROGRAMS 10000
+#define DEFAULT_BUDGET 256
+#define DEFAULT_LINES 32
+
+static const char* reg_names[] = { "ax", "bx", "cx", "dx" };
+static const char* stop_names[] = { "halted", "budget", "fault" };
+
+typedef struct fuzz_line {
+    char text[FUZZ_LINE_LEN];
+    // jmp/jz target, -1 for other instructions, kept apart so minimizing can move it
+    int32_t target;
+} fuzz_line_t;
+
+typedef struct fuzz_state {
+    uint8_t regs[4];
+    uint8_t fl;
+    uint8_t sp;
+    uint8_t memory[FUZZ_MEMORY];
+    uint8_t stack[FUZZ_STACK];
+} fuzz_state_t;
+
+typedef struct fuzz_case {
+    fuzz_line_t lines[MAX_FUZZ_LINES];
+    uint32_t length;
+    fuzz_state_t states[FUZZ_LANES];
+} fuzz_case_t;
+
+typedef void (*engine_run_t)(machine_t** machines, uint32_t n, const program_t* program, uint64_t n_instructions, STOP_REASON* reasons);
+
+typedef struct engine {
+    const char* name;
+    engine_run_t run;
+    machine_t* machines[FUZZ_LANES];
+    STOP_REASON reasons[FUZZ_LANES];
+} engine_t;
+
+static void run_decoded_lanes(machine_t** machines, uint32_t n, const program_t* program, uint64_t n_instructions, STOP_REASON* reasons) {
+    for(uint32_t i = 0; i < n; ++i) {
+        reasons[i] = run_decoded(machines[i], program, n_instructions);
+    }
+}
+
+// engines compared against the string interpreter
+static engine_t engines[] = {
+    { "decoded", run_decoded_lanes },
+    { "simd", run_simd }
+};
+#define ENGINE_COUNT (sizeof(engines) / sizeof(engines[0]))
+
+typedef struct fuzzer {
+    machine_t* reference[FUZZ_LANES];
+    STOP_REASON reasons[FUZZ_LANES];
+    uint64_t budget;
+    uint64_t executions;
+
+    // first mismatch of the last run_case()
+    const engine_t* engine;
+    uint32_t lane;
+    const char* field;
+} fuzzer_t;
+
+// xorshift64*, seeded per case so every case can be replayed from its seed
+static uint64_t next_random(uint64_t* rng) {
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 0x2545f4914f6cdd1dull;
+}
+
+static uint32_t random_below(uint64_t* rng, uint32_t n) {
+    return (uint32_t)(next_random(rng) >> 32) % n;
+}
+
+static const char* random_reg(uint64_t* rng) {
+    return reg_names[random_below(rng, 4)];
+}
+
+// `$reg` or a literal, biased towards the values that hit edge cases
+static void random_value(uint64_t* rng, char* buf, size_t len) {
+    switch(random_below(rng, 6)) {
+        case 0:
+        case 1: snprintf(buf, len, "$%s", random_reg(rng)); break;
+        case 2: snprintf(buf, len, "%u", random_below(rng, 4)); break;
+        case 3: snprintf(buf, len, "%u", 255 - random_below(rng, 2)); break;
+        case 4: snprintf(buf, len, "%u", random_below(rng, 300)); break;
+        default: snprintf(buf, len, "%u", random_below(rng, 16)); break;
+    }
+}
+
+// mostly inside the seeded window, sometimes around the end of memory to hit the bounds checks
+static uint32_t random_addr(uint64_t* rng) {
+    if(random_below(rng, 8) == 0) {
+        return GEN_MEM_CAPACITY - 16 + random_below(rng, 32);
+    }
+    return random_below(rng, FUZZ_MEMORY);
+}
+
+// `hi:lo` with two different registers, now and then a malformed one that must fault
+static void random_pair(uint64_t* rng, char* buf, size_t len) {
+    static const char* bad_pairs[] = { "bx:bx", "ex:cx", "ax:", ":dx", "axcx", "ax:bx:cx" };
+    if(random_below(rng, 8) == 0) {
+        snprintf(buf, len, "%s", bad_pairs[random_below(rng, sizeof(bad_pairs) / sizeof(bad_pairs[0]))]);
+        return;
+    }
+    uint32_t hi = random_below(rng, 4);
+    uint32_t lo = (hi + 1 + random_below(rng, 3)) % 4;
+    snprintf(buf, len, "%s:%s", reg_names[hi], reg_names[lo]);
+}
+
+// instructions the engines must reject with a fault, and skip
+static const char* invalid_lines[] = {
+    "foo", "mov ex 1", "add ex 1", "sub ex $ax", "mul ex 2", "div ex 3", "mov ex [bx:cx]",
+    "mov [bx:cx] [ax:dx]", "mov [bx:cx", "mov ax [bx:cx", "lea bx:cx 5", "push ex", "pop ex"
+};
+
+static void random_line(uint64_t* rng, fuzz_line_t* line, uint32_t length) {
+    static const char* arith[] = { "add", "sub", "mul", "div" };
+    char value[16], extra[16], pair[16];
+    line->target = -1;
+    random_value(rng, value, sizeof(value));
+    random_value(rng, extra, sizeof(extra));
+    random_pair(rng, pair, sizeof(pair));
+    const char* increment = random_below(rng, 2) ? "+" : "";
+
+    switch(random_below(rng, 20)) {
+        case 0: snprintf(line->text, FUZZ_LINE_LEN, "mov %s %s", random_reg(rng), value); break;
+        case 1: snprintf(line->text, FUZZ_LINE_LEN, "mov %%%u %s", random_addr(rng), value); break;
+        case 2:
+        case 3:
+        case 4:
+        case 5: snprintf(line->text, FUZZ_LINE_LEN, "%s %s %s", arith[random_below(rng, 4)], random_reg(rng), value); break;
+        case 6:
+        case 7: snprintf(line->text, FUZZ_LINE_LEN, "cmp %s %s", random_reg(rng), random_reg(rng)); break;
+        case 8:
+        case 9: {
+            // one past the last line runs off the program
+            snprintf(line->text, FUZZ_LINE_LEN, "%s", random_below(rng, 3) == 0 ? "jmp" : "jz");
+            line->target = random_below(rng, length + 1);
+            break;
+        }
+        case 10: snprintf(line->text, FUZZ_LINE_LEN, "push %s", random_reg(rng)); break;
+        case 11: snprintf(line->text, FUZZ_LINE_LEN, "pop %s", random_reg(rng)); break;
+        case 12: snprintf(line->text, FUZZ_LINE_LEN, "fill %%%u %s %s", random_addr(rng), value, extra); break;
+        case 13: snprintf(line->text, FUZZ_LINE_LEN, "copy %%%u %%%u %s", random_addr(rng), random_addr(rng), value); break;
+        case 14: snprintf(line->text, FUZZ_LINE_LEN, "mcmp %%%u %%%u %s", random_addr(rng), random_addr(rng), value); break;
+        case 15: snprintf(line->text, FUZZ_LINE_LEN, "lea %s %%%u", pair, random_addr(rng)); break;
+        case 16: snprintf(line->text, FUZZ_LINE_LEN, "mov %s [%s%s]", random_reg(rng), pair, increment); break;
+        case 17: snprintf(line->text, FUZZ_LINE_LEN, "mov [%s%s] %s", pair, increment, value); break;
+        case 18: {
+            if(random_below(rng, 4) != 0) {
+                snprintf(line->text, FUZZ_LINE_LEN, "nop");
+            } else {
+                snprintf(line->text, FUZZ_LINE_LEN, "%s", invalid_lines[random_below(rng, sizeof(invalid_lines) / sizeof(invalid_lines[0]))]);
+            }
+            break;
+        }
+        default: snprintf(line->text, FUZZ_LINE_LEN, "%s", random_below(rng, 4) == 0 ? "end" : "nop"); break;
+    }
+}
+
+static void random_case(fuzz_case_t* fcase, uint64_t seed, uint32_t max_lines) {
+    // splitmix64 step, xorshift must not start from 0
+    uint64_t rng = seed + 0x9e3779b97f4a7c15ull;
+    rng = (rng ^ (rng >> 30)) * 0xbf58476d1ce4e5b9ull;
+    rng = (rng ^ (rng >> 27)) * 0x94d049bb133111ebull;
+    rng = (rng ^ (rng >> 31)) | 1;
+
+    fcase->length = 1 + random_below(&rng, max_lines);
+    for(uint32_t i = 0; i < fcase->length; ++i) {
+        random_line(&rng, &fcase->lines[i], fcase->length);
+    }
+    if(random_below(&rng, 2) == 0) {
+        snprintf(fcase->lines[fcase->length - 1].text, FUZZ_LINE_LEN, "end");
+        fcase->lines[fcase->length - 1].target = -1;
+    }
+
+    for(uint32_t l = 0; l < FUZZ_LANES; ++l) {
+        fuzz_state_t* state = &fcase->states[l];
+        for(uint32_t r = 0; r < 4; ++r) {
+            state->regs[r] = random_below(&rng, 4) == 0 ? random_below(&rng, 4) : random_below(&rng, 256);
+        }
+        state->fl = random_below(&rng, 2);
+        // mostly a few values on the stack, sometimes an empty or almost full one
+        uint32_t depth = random_below(&rng, 8);
+        state->sp = depth == 0 ? 0 : depth == 1 ? STACK_DEPTH - random_below(&rng, 3) : random_below(&rng, FUZZ_STACK + 1);
+        for(uint32_t i = 0; i < FUZZ_STACK; ++i) {
+            state->stack[i] = random_below(&rng, 256);
+        }
+        for(uint32_t i = 0; i < FUZZ_MEMORY; ++i) {
+            state->memory[i] = random_below(&rng, 4) == 0 ? 0 : random_below(&rng, 256);
+        }
+    }
+}
+
+static void format_line(const fuzz_line_t* line, char* buf) {
+    if(line->target >= 0) {
+        snprintf(buf, MAX_LINE_LEN, "%s %d", line->text, line->target);
+    } else {
+        snprintf(buf, MAX_LINE_LEN, "%s", line->text);
+    }
+}
+
+// machines are reset, never reallocated, between runs
+static void seed_machine(machine_t* machine, const fuzz_state_t* state) {
+    reset(machine);
+    for(uint32_t r = 0; r < 4; ++r) {
+        set_reg(machine, r, state->regs[r]);
+    }
+    set_reg(machine, fl, state->fl);
+    set_reg(machine, sp, state->sp);
+    write_memory(machine, 0, state->memory, FUZZ_MEMORY);
+    memcpy(machine->stack, state->stack, FUZZ_STACK);
+}
+
+#define COMPARE_FIELD(field) if(a->field != b->field) { return #field; }
+
+// name of the first field the two machines disagree on, NULL if they match
+static const char* compare_machines(const machine_t* a, const machine_t* b) {
+    COMPARE_FIELD(ax) COMPARE_FIELD(bx) COMPARE_FIELD(cx) COMPARE_FIELD(dx)
+    COMPARE_FIELD(sp) COMPARE_FIELD(bp) COMPARE_FIELD(pc) COMPARE_FIELD(fl)
+    COMPARE_FIELD(halt)
+    COMPARE_FIELD(err_counter)
+    COMPARE_FIELD(cycles)
+    COMPARE_FIELD(stats.instructions)
+    COMPARE_FIELD(stats.branches)
+    COMPARE_FIELD(stats.memory_reads)
+    COMPARE_FIELD(stats.memory_writes)
+    COMPARE_FIELD(stats.stack_high_water)
+    if(memcmp(a->general_memory, b->general_memory, GEN_MEM_CAPACITY) != 0) {
+        return "memory";
+    }
+    if(memcmp(a->stack, b->stack, STACK_CAPACITY) != 0) {
+        return "stack";
+    }
+    return NULL;
+}
+
+// faults are expected, count them without printing
+static int count_fault(machine_t* machine, uint32_t pc, const char* message, void* user_data) {
+    return 0;
+}
+
+static machine_t* create_fuzz_machine(void) {
+    machine_t* machine = create_machine();
+    if(machine != NULL) {
+        set_fault_callback(machine, count_fault, NULL);
+    }
+    return machine;
+}
+
+static uint32_t create_fuzzer(fuzzer_t* fuzzer, uint64_t budget) {
+    memset(fuzzer, 0, sizeof(fuzzer_t));
+    fuzzer->budget = budget;
+    for(uint32_t l = 0; l < FUZZ_LANES; ++l) {
+        if((fuzzer->reference[l] = create_fuzz_machine()) == NULL) {
+            return 1;
+        }
+        for(uint32_t e = 0; e < ENGINE_COUNT; ++e) {
+            if((engines[e].machines[l] = create_fuzz_machine()) == NULL) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// the other reference machines borrow the lines of reference[0], drop them before it frees them
+static void release_program(fuzzer_t* fuzzer) {
+    for(uint32_t l = 1; l < FUZZ_LANES; ++l) {
+        if(fuzzer->reference[l] != NULL) {
+            memset(fuzzer->reference[l]->program_memory, 0, sizeof(fuzzer->reference[l]->program_memory));
+        }
+    }
+}
+
+static void destroy_fuzzer(fuzzer_t* fuzzer) {
+    release_program(fuzzer);
+    for(uint32_t l = 0; l < FUZZ_LANES; ++l) {
+        destroy_machine(fuzzer->reference[l]);
+        for(uint32_t e = 0; e < ENGINE_COUNT; ++e) {
+            destroy_machine(engines[e].machines[l]);
+            engines[e].machines[l] = NULL;
+        }
+    }
+}
+
+// runs one case on every engine, returns 1 and records the first mismatch if they disagree
+static uint32_t run_case(fuzzer_t* fuzzer, const fuzz_case_t* fcase) {
+    // the program is built once, every lane runs the same lines
+    char buf[MAX_LINE_LEN];
+    release_program(fuzzer);
+    clear_program_memory(fuzzer->reference[0]);
+    for(uint32_t i = 0; i < fcase->length; ++i) {
+        format_line(&fcase->lines[i], buf);
+        add_to_program_memory(fuzzer->reference[0], buf);
+    }
+    for(uint32_t l = 0; l < FUZZ_LANES; ++l) {
+        machine_t* machine = fuzzer->reference[l];
+        if(l != 0) {
+            memcpy(machine->program_memory, fuzzer->reference[0]->program_memory, sizeof(machine->program_memory));
+        }
+        seed_machine(machine, &fcase->states[l]);
+        fuzzer->reasons[l] = run_for(machine, fuzzer->budget);
+    }
+    fuzzer->executions += FUZZ_LANES;
+
+    program_t program;
+    if(decode_program(&program, fuzzer->reference[0]) != 0) {
+        return 0;
+    }
+
+    uint32_t is_mismatch = 0;
+    for(uint32_t e = 0; e < ENGINE_COUNT && !is_mismatch; ++e) {
+        engine_t* engine = &engines[e];
+        for(uint32_t l = 0; l < FUZZ_LANES; ++l) {
+            seed_machine(engine->machines[l], &fcase->states[l]);
+        }
+        engine->run(engine->machines, FUZZ_LANES, &program, fuzzer->budget, engine->reasons);
+        fuzzer->executions += FUZZ_LANES;
+
+        for(uint32_t l = 0; l < FUZZ_LANES; ++l) {
+            const char* field = engine->reasons[l] != fuzzer->reasons[l] ? "stop" : compare_machines(fuzzer->reference[l], engine->machines[l]);
+            if(field != NULL) {
+                fuzzer->engine = engine;
+                fuzzer->lane = l;
+                fuzzer->field = field;
+                is_mismatch = 1;
+                break;
+            }
+        }
+    }
+
+    free_program(&program);
+    return is_mismatch;
+}
+
+// drop a line, jumps behind it move up by one
+static void remove_line(fuzz_case_t* fcase, uint32_t index) {
+    memmove(&fcase->lines[index], &fcase->lines[index + 1], (fcase->length - index - 1) * sizeof(fuzz_line_t));
+    fcase->length--;
+    for(uint32_t i = 0; i < fcase->length; ++i) {
+        if(fcase->lines[i].target > (int32_t)index) {
+            fcase->lines[i].target--;
+        }
+    }
+}
+
+// shrink a failing case as long as it keeps failing: cut the tail, turn lines into nops, remove nops
+static void minimize_case(fuzzer_t* fuzzer, fuzz_case_t* fcase) {
+    fuzz_case_t* saved = malloc(sizeof(fuzz_case_t));
+    if(saved == NULL) {
+        return;
+    }
+
+    uint32_t is_changed = 1;
+    while(is_changed) {
+        is_changed = 0;
+
+        while(fcase->length > 1) {
+            fcase->length--;
+            if(!run_case(fuzzer, fcase)) {
+                fcase->length++;
+                break;
+            }
+            is_changed = 1;
+        }
+
+        for(uint32_t i = 0; i < fcase->length; ++i) {
+            if(strcmp(fcase->lines[i].text, "nop") == 0) {
+                continue;
+            }
+            fuzz_line_t line = fcase->lines[i];
+            snprintf(fcase->lines[i].text, FUZZ_LINE_LEN, "nop");
+            fcase->lines[i].target = -1;
+            if(run_case(fuzzer, fcase)) {
+                is_changed = 1;
+            } else {
+                fcase->lines[i] = line;
+            }
+        }
+
+        for(uint32_t i = 0; i < fcase->length && fcase->length > 1;) {
+            if(strcmp(fcase->lines[i].text, "nop") != 0) {
+                ++i;
+                continue;
+            }
+            memcpy(saved, fcase, sizeof(fuzz_case_t));
+            remove_line(fcase, i);
+            if(run_case(fuzzer, fcase)) {
+                is_changed = 1;
+            } else {
+                memcpy(fcase, saved, sizeof(fuzz_case_t));
+                ++i;
+            }
+        }
+    }
+
+    free(saved);
+    // leave the mismatch of the minimized case in the fuzzer
+    run_case(fuzzer, fcase);
+}
+
+static void print_machine(const char* name, const machine_t* machine, STOP_REASON reason) {
+    fprintf(stdout, "%8s: ax=%u bx=%u cx=%u dx=%u sp=%u pc=%u fl=%u errors=%u stop=%s instructions=%llu cycles=%llu\n",
+        name, machine->ax, machine->bx, machine->cx, machine->dx, machine->sp, machine->pc, machine->fl,
+        machine->err_counter, stop_names[reason], (unsigned long long)machine->stats.instructions,
+        (unsigned long long)machine->cycles);
+}
+
+static void print_mismatch(const fuzzer_t* fuzzer, const fuzz_case_t* fcase, uint64_t seed) {
+    char buf[MAX_LINE_LEN];
+    const fuzz_state_t* state = &fcase->states[fuzzer->lane];
+
+    fprintf(stdout, "[-] kyfuzz : `%s` differs between string and %s engine, lane %u (seed %llu)\n",
+        fuzzer->field, fuzzer->engine->name, fuzzer->lane, (unsigned long long)seed);
+    fprintf(stdout, "program (minimized, %u lines):\n", fcase->length);
+    for(uint32_t i = 0; i < fcase->length; ++i) {
+        format_line(&fcase->lines[i], buf);
+        fprintf(stdout, "%4u: %s\n", i, buf);
+    }
+    fprintf(stdout, "initial state: ax=%u bx=%u cx=%u dx=%u fl=%u sp=%u\nstack:", state->regs[ax], state->regs[bx], state->regs[cx], state->regs[dx], state->fl, state->sp);
+    for(uint32_t i = 0; i < FUZZ_STACK; ++i) {
+        fprintf(stdout, " %02x", state->stack[i]);
+    }
+    fprintf(stdout, "\nmemory:");
+    for(uint32_t i = 0; i < FUZZ_MEMORY; ++i) {
+        fprintf(stdout, "%s%02x", i % 16 == 0 ? "\n    " : " ", state->memory[i]);
+    }
+    fprintf(stdout, "\n");
+    print_machine("string", fuzzer->reference[fuzzer->lane], fuzzer->reasons[fuzzer->lane]);
+    print_machine(fuzzer->engine->name, fuzzer->engine->machines[fuzzer->lane], fuzzer->engine->reasons[fuzzer->lane]);
+}
+
+int main(int argc, char** argv) {
+    uint64_t n_programs = DEFAULT_PROGRAMS;
+    uint64_t seed = (uint64_t)time(NULL);
+    uint64_t budget = DEFAULT_BUDGET;
+    uint32_t max_lines = DEFAULT_LINES;
+    double max_seconds = 0;
+
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-h") == 0) {
+            fprintf(stdout, "Usage: kyfuzz [-n <programs>] [-s <seed>] [-b <budget>] [-l <lines>] [-t <seconds>]\n"
+                "\t-n <programs>: programs to generate (default %d), 0 runs until -t or a mismatch\n"
+                "\t-s <seed>: seed of the first program (default: current time)\n"
+                "\t-b <budget>: instruction budget of a single run (default %d)\n"
+                "\t-l <lines>: maximum program length (default %d, max. %d)\n"
+                "\t-t <seconds>: stop after this many seconds\n",
+                DEFAULT_PROGRAMS, DEFAULT_BUDGET, DEFAULT_LINES, MAX_FUZZ_LINES);
+            return 0;
+        }
+        if(i+1 >= argc) {
+            fprintf(stderr, "[-] - missing value for %s\n", argv[i]);
+            return -1;
+        }
+        if(strcmp(argv[i], "-n") == 0) {
+            n_programs = strtoull(argv[++i], NULL, 0);
+        } else if(strcmp(argv[i], "-s") == 0) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if(strcmp(argv[i], "-b") == 0) {
+            budget = strtoull(argv[++i], NULL, 0);
+        } else if(strcmp(argv[i], "-l") == 0) {
+            max_lines = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-t") == 0) {
+            max_seconds = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "[-] - unknown option %s\n", argv[i]);
+            return -1;
+        }
+    }
+    if(budget == 0) {
+        fprintf(stderr, "[-] - budget must be at least 1\n");
+        return -1;
+    }
+    if(max_lines == 0 || max_lines > MAX_FUZZ_LINES) {
+        fprintf(stderr, "[-] - program length must be between 1 and %d\n", MAX_FUZZ_LINES);
+        return -1;
+    }
+
+    fuzzer_t fuzzer;
+    fuzz_case_t* fcase = malloc(sizeof(fuzz_case_t));
+    if(create_fuzzer(&fuzzer, budget) != 0 || fcase == NULL) {
+        fprintf(stderr, "[-] - out of memory\n");
+        free(fcase);
+        destroy_fuzzer(&fuzzer);
+        return -1;
+    }
+
+    uint64_t start_ns = get_time_ns();
+    uint64_t deadline_ns = start_ns + (uint64_t)(max_seconds * 1e9);
+    uint64_t n = 0;
+    int result = 0;
+    while(n_programs == 0 || n < n_programs) {
+        if(max_seconds > 0 && get_time_ns() >= deadline_ns) {
+            break;
+        }
+        random_case(fcase, seed + n, max_lines);
+        ++n;
+        if(run_case(&fuzzer, fcase)) {
+            minimize_case(&fuzzer, fcase);
+            print_mismatch(&fuzzer, fcase, seed + n - 1);
+            result = 1;
+            break;
+        }
+    }
+
+    uint64_t elapsed_ns = get_time_ns() - start_ns;
+    fprintf(stdout, "FUZZ: %llu programs, %llu executions in %.3f ms (%.0f executions/s), seeds %llu..%llu, %s\n",
+        (unsigned long long)n, (unsigned long long)fuzzer.executions, elapsed_ns / 1e6,
+        elapsed_ns != 0 ? fuzzer.executions * 1e9 / elapsed_ns : 0.0,
+        (unsigned long long)seed, (unsigned long long)(seed + n - 1), result ? "mismatch" : "no mismatches");
+
+    free(fcase);
+    destroy_fuzzer(&fuzzer);
+    return result;
+}
@@ -0,0 +1,584 @@
+#include "linker.h"
+
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef __unix__
+#include <unistd.h>
+#else
+#include <process.h>
+#define getpid _getpid
+#endif
+
+typedef struct assemble_job {
+    object_t* objects;
+    uint32_t count;
+    uint32_t next;
+    int is_verbose;
+    pthread_mutex_t lock;
+} assemble_job_t;
+
+static int is_number(const char* s) {
+    if(*s == 0) {
+        return 0;
+    }
+    while(*s != 0) {
+        if(*s < '0' || *s > '9') {
+            return 0;
+        }
+        ++s;
+    }
+    return 1;
+}
+
+static const symbol_t* find_symbol(const object_t* object, const char* name) {
+    for(uint32_t i = 0; i < object->symbol_count; ++i) {
+        if(strcmp(object->symbols[i].name, name) == 0) {
+            return &object->symbols[i];
+        }
+    }
+    return NULL;
+}
+
+static void add_line(object_t* object, const char* line, uint32_t ln) {
+    if(object->line_count >= MAX_PROGRAM_LINES) {
+        fprintf(stderr, "[-] assemble_file() : %s:%u: more lines than pc can reach (%d)\n", object->source_path, ln, MAX_PROGRAM_LINES);
+        ++object->err_counter;
+        return;
+    }
+    object->lines[object->line_count] = malloc(strlen(line)+1);
+    strcpy(object->lines[object->line_count], line);
+    object->line_count++;
+}
+
+static void add_symbol(object_t* object, const char* name, uint32_t index, int is_global, uint32_t ln) {
+    if(strlen(name) == 0 || strlen(name) >= MAX_SYMBOL_LEN) {
+        fprintf(stderr, "[-] assemble_file() : %s:%u: invalid label name `%s`\n", object->source_path, ln, name);
+        ++object->err_counter;
+        return;
+    }
+    if(find_symbol(object, name) != NULL) {
+        fprintf(stderr, "[-] assemble_file() : %s:%u: duplicate label `%s`\n", object->source_path, ln, name);
+        ++object->err_counter;
+        return;
+    }
+    if(object->symbol_count >= MAX_SYMBOLS) {
+        fprintf(stderr, "[-] assemble_file() : %s:%u: too many labels\n", object->source_path, ln);
+        ++object->err_counter;
+        return;
+    }
+    symbol_t* symbol = &object->symbols[object->symbol_count++];
+    strcpy(symbol->name, name);
+    symbol->index = index;
+    symbol->is_global = is_global;
+}
+
+static void add_include(object_t* object, const char* name, uint32_t ln) {
+    if(strlen(name) >= MAX_PATH_LEN || object->include_count >= MAX_MODULES) {
+        fprintf(stderr, "[-] assemble_file() : %s:%u: invalid include `%s`\n", object->source_path, ln, name);
+        ++object->err_counter;
+        return;
+    }
+    strcpy(object->includes[object->include_count++], name);
+}
+
+void free_object(object_t* object) {
+    for(uint32_t i = 0; i < object->line_count; ++i) {
+        free(object->lines[i]);
+        object->lines[i] = NULL;
+    }
+    object->line_count = 0;
+    object->symbol_count = 0;
+    object->include_count = 0;
+    object->is_cached = 0;
+    object->err_counter = 0;
+}
+
+uint32_t assemble_buffer(object_t* object, const char* source) {
+    const char* source_path = object->source_path;
+    free_object(object);
+
+    // `global` may come before the label itself, so resolve them after the whole file is read
+    char globals[MAX_SYMBOLS][MAX_SYMBOL_LEN];
+    uint32_t global_lines[MAX_SYMBOLS];
+    uint32_t global_count = 0;
+
+    char buf[MAX_LINE_LEN];
+    uint32_t ln = 0;
+    const char* line_start = source;
+    while(*line_start != 0) {
+        ++ln;
+        size_t line_len = strcspn(line_start, "\n");
+        if(line_len >= MAX_LINE_LEN) {
+            fprintf(stderr, "[-] assemble_file() : %s:%u: line too long\n", source_path, ln);
+            ++object->err_counter;
+            line_start += line_len + (line_start[line_len] != 0);
+            continue;
+        }
+        memcpy(buf, line_start, line_len);
+        buf[line_len] = 0;
+        line_start += line_len + (line_start[line_len] != 0);
+        buf[strcspn(buf, "\r")] = 0;
+
+        char* line_contents[MAX_LINE_ELEMENTS];
+        uint32_t line_elem_counter = split_line(buf, line_contents, MAX_LINE_ELEMENTS);
+        char** tokens = line_contents;
+
+        // skip empty lines and comments
+        if(line_elem_counter == 0 || tokens[0][0] == ';') {
+            continue;
+        }
+
+        size_t len = strlen(tokens[0]);
+        if(tokens[0][len-1] == ':') {
+            tokens[0][len-1] = 0;
+            add_symbol(object, tokens[0], object->line_count, 0, ln);
+            ++tokens;
+            --line_elem_counter;
+            if(line_elem_counter == 0 || tokens[0][0] == ';') {
+                continue;
+            }
+        }
+
+        if(strcmp(tokens[0], "global") == 0) {
+            if(line_elem_counter != 2 || strlen(tokens[1]) >= MAX_SYMBOL_LEN || global_count >= MAX_SYMBOLS) {
+                fprintf(stderr, "[-] assemble_file() : %s:%u: invalid `global` directive\n", source_path, ln);
+                ++object->err_counter;
+                continue;
+            }
+            global_lines[global_count] = ln;
+            strcpy(globals[global_count++], tokens[1]);
+        } else if(strcmp(tokens[0], "include") == 0) {
+            if(line_elem_counter != 2) {
+                fprintf(stderr, "[-] assemble_file() : %s:%u: invalid `include` directive\n", source_path, ln);
+                ++object->err_counter;
+                continue;
+            }
+            add_include(object, tokens[1], ln);
+        } else {
+            // store the instruction in normalized form, separated by single spaces
+            char line[MAX_LINE_LEN] = "";
+            for(uint32_t i = 0; i < line_elem_counter; ++i) {
+                if(i != 0) {
+                    strcat(line, " ");
+                }
+                strcat(line, tokens[i]);
+            }
+            add_line(object, line, ln);
+        }
+    }
+
+    for(uint32_t i = 0; i < global_count; ++i) {
+        symbol_t* symbol = (symbol_t*)find_symbol(object, globals[i]);
+        if(symbol == NULL) {
+            fprintf(stderr, "[-] assemble_file() : %s:%u: global label `%s` is not defined\n", source_path, global_lines[i], globals[i]);
+            ++object->err_counter;
+            continue;
+        }
+        symbol->is_global = 1;
+    }
+
+    return object->err_counter;
+}
+
+uint32_t assemble_file(object_t* object, const char* source_path) {
+    if(object->source_path != source_path) {
+        strcpy(object->source_path, source_path);
+    }
+    free_object(object);
+
+    FILE* fp = fopen(source_path, "rb");
+    if(fp == NULL) {
+        fprintf(stderr, "[-] assemble_file() : cannot open source file %s\n", source_path);
+        return ++object->err_counter;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* source = size >= 0 ? malloc(size + 1) : NULL;
+    if(source == NULL || fread(source, 1, size, fp) != (size_t)size) {
+        fprintf(stderr, "[-] assemble_file() : cannot read source file %s\n", source_path);
+        free(source);
+        fclose(fp);
+        return ++object->err_counter;
+    }
+    source[size] = 0;
+    fclose(fp);
+
+    assemble_buffer(object, source);
+    free(source);
+    return object->err_counter;
+}
+
+// written under a temporary name and renamed into place, so a crashed or concurrent
+// build never leaves a partial object behind; the trailer lets load_object() check it
+uint32_t write_object(const object_t* object) {
+    char tmp_path[MAX_PATH_LEN + 16];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", object->object_path, (long)getpid());
+
+    FILE* fp = fopen(tmp_path, "w");
+    if(fp == NULL) {
+        fprintf(stderr, "[-] write_object() : cannot open object file %s\n", tmp_path);
+        return 1;
+    }
+
+    int is_failed = fprintf(fp, "kyobj %d\n", OBJECT_FILE_VERSION) < 0;
+    for(uint32_t i = 0; i < object->include_count; ++i) {
+        is_failed |= fprintf(fp, "include %s\n", object->includes[i]) < 0;
+    }
+    for(uint32_t i = 0; i < object->symbol_count; ++i) {
+        is_failed |= fprintf(fp, "symbol %s %u %d\n", object->symbols[i].name, object->symbols[i].index, object->symbols[i].is_global) < 0;
+    }
+    for(uint32_t i = 0; i < object->line_count; ++i) {
+        is_failed |= fprintf(fp, "line %s\n", object->lines[i]) < 0;
+    }
+    is_failed |= fprintf(fp, "end %u %u %u\n", object->include_count, object->symbol_count, object->line_count) < 0;
+    is_failed |= fclose(fp) != 0;
+
+#ifndef __unix__
+    // rename() doesn't replace an existing file on windows
+    if(!is_failed) {
+        remove(object->object_path);
+    }
+#endif
+    if(is_failed || rename(tmp_path, object->object_path) != 0) {
+        fprintf(stderr, "[-] write_object() : cannot write object file %s\n", object->object_path);
+        remove(tmp_path);
+        return 1;
+    }
+    return 0;
+}
+
+uint32_t load_object(object_t* object) {
+    free_object(object);
+
+    FILE* fp = fopen(object->object_path, "r");
+    if(fp == NULL) {
+        return 1;
+    }
+
+    char buf[MAX_LINE_LEN];
+    int version = 0;
+    if(fgets(buf, MAX_LINE_LEN, fp) == NULL || sscanf(buf, "kyobj %d", &version) != 1 || version != OBJECT_FILE_VERSION) {
+        fclose(fp);
+        return 1;
+    }
+
+    int is_complete = 0;
+    while(fgets(buf, MAX_LINE_LEN, fp)) {
+        buf[strcspn(buf, "\r\n")] = 0;
+
+        if(strncmp(buf, "end ", 4) == 0) {
+            // trailer, counts must match what was read and nothing may follow it
+            uint32_t include_count, symbol_count, line_count;
+            is_complete = sscanf(buf + 4, "%u %u %u", &include_count, &symbol_count, &line_count) == 3
+                && include_count == object->include_count && symbol_count == object->symbol_count
+                && line_count == object->line_count && fgets(buf, MAX_LINE_LEN, fp) == NULL;
+            break;
+        } else if(strncmp(buf, "line ", 5) == 0) {
+            add_line(object, buf + 5, 0);
+        } else if(strncmp(buf, "include ", 8) == 0) {
+            add_include(object, buf + 8, 0);
+        } else if(strncmp(buf, "symbol ", 7) == 0) {
+            char name[MAX_SYMBOL_LEN];
+            uint32_t index;
+            int is_global;
+            if(sscanf(buf + 7, "%31s %u %d", name, &index, &is_global) != 3) {
+                ++object->err_counter;
+                break;
+            }
+            add_symbol(object, name, index, is_global, 0);
+        } else {
+            ++object->err_counter;
+            break;
+        }
+    }
+
+    fclose(fp);
+
+    // truncated or damaged, the caller reassembles the source
+    if(object->err_counter != 0 || !is_complete) {
+        free_object(object);
+        return 1;
+    }
+    object->is_cached = 1;
+    return 0;
+}
+
+// an object is only reused if it was written after the last change of its source
+// with whole seconds an object written in the same second as its source always looks stale
+static uint64_t get_mtime_ns(const struct stat* file_stat) {
+#ifdef __unix__
+    return (uint64_t)file_stat->st_mtim.tv_sec * 1000000000ull + file_stat->st_mtim.tv_nsec;
+#else
+    return (uint64_t)file_stat->st_mtime * 1000000000ull;
+#endif
+}
+
+static int is_object_up_to_date(const object_t* object) {
+    struct stat source_stat, object_stat;
+    if(stat(object->source_path, &source_stat) != 0 || stat(object->object_path, &object_stat) != 0) {
+        return 0;
+    }
+    return get_mtime_ns(&object_stat) > get_mtime_ns(&source_stat);
+}
+
+static void set_object_path(object_t* object) {
+    strcpy(object->object_path, object->source_path);
+    char* ext = strrchr(object->object_path, '.');
+    char* sep = strrchr(object->object_path, '/');
+    if(ext == NULL || (sep != NULL && ext < sep)) {
+        ext = object->object_path + strlen(object->object_path);
+    }
+    if(ext - object->object_path + strlen(OBJECT_FILE_EXT) >= MAX_PATH_LEN) {
+        object->object_path[0] = 0;
+        return;
+    }
+    strcpy(ext, OBJECT_FILE_EXT);
+}
+
+static void build_object(object_t* object, int is_verbose) {
+    set_object_path(object);
+
+    if(object->object_path[0] != 0 && is_object_up_to_date(object) && load_object(object) == 0) {
+        if(is_verbose == 1) {
+            printf("[+] %s is up to date\n", object->source_path);
+        }
+        return;
+    }
+
+    if(assemble_file(object, object->source_path) == 0) {
+        if(is_verbose == 1) {
+            printf("[+] assembled %s\n", object->source_path);
+        }
+        // a failed write only costs a reassembly next time
+        if(object->object_path[0] != 0) {
+            write_object(object);
+        }
+    }
+}
+
+static void* assemble_worker(void* arg) {
+    assemble_job_t* job = (assemble_job_t*)arg;
+    while(1) {
+        pthread_mutex_lock(&job->lock);
+        uint32_t i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+
+        if(i >= job->count) {
+            break;
+        }
+        build_object(&job->objects[i], job->is_verbose);
+    }
+    return NULL;
+}
+
+static void assemble_parallel(object_t* objects, uint32_t count, int is_verbose) {
+    assemble_job_t job;
+    job.objects = objects;
+    job.count = count;
+    job.next = 0;
+    job.is_verbose = is_verbose;
+    pthread_mutex_init(&job.lock, NULL);
+
+    uint32_t n_threads = get_core_count();
+    if(n_threads > count) {
+        n_threads = count;
+    }
+    if(n_threads > MAX_ASSEMBLER_THREADS) {
+        n_threads = MAX_ASSEMBLER_THREADS;
+    }
+
+    pthread_t threads[MAX_ASSEMBLER_THREADS];
+    uint32_t started = 0;
+    // the calling thread works too, so one file needs no extra thread at all
+    while(started + 1 < n_threads) {
+        if(pthread_create(&threads[started], NULL, assemble_worker, &job) != 0) {
+            break;
+        }
+        ++started;
+    }
+    assemble_worker(&job);
+    for(uint32_t i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&job.lock);
+}
+
+static const symbol_t* find_global(const object_t* objects, uint32_t n, const char* name, const object_t** owner) {
+    for(uint32_t i = 0; i < n; ++i) {
+        const symbol_t* symbol = find_symbol(&objects[i], name);
+        if(symbol != NULL && symbol->is_global) {
+            *owner = &objects[i];
+            return symbol;
+        }
+    }
+    return NULL;
+}
+
+uint32_t link_objects(machine_t* machine, object_t* objects, uint32_t n) {
+    uint32_t err_counter = 0;
+
+    // lay out the modules one after the other
+    uint32_t size = 0;
+    for(uint32_t i = 0; i < n; ++i) {
+        objects[i].base = size;
+        size += objects[i].line_count;
+    }
+    if(size > MAX_PROGRAM_LINES) {
+        fprintf(stderr, "[-] link_objects() : program image is %u lines, pc reaches %d\n", size, MAX_PROGRAM_LINES);
+        return 1;
+    }
+
+    for(uint32_t i = 0; i < n; ++i) {
+        for(uint32_t j = 0; j < objects[i].symbol_count; ++j) {
+            const symbol_t* symbol = &objects[i].symbols[j];
+            const object_t* owner;
+            if(symbol->is_global && find_global(objects, i, symbol->name, &owner) != NULL) {
+                fprintf(stderr, "[-] link_objects() : %s: global label `%s` is already defined\n", objects[i].source_path, symbol->name);
+                ++err_counter;
+            }
+        }
+    }
+
+    for(uint32_t i = 0; i < n; ++i) {
+        const object_t* object = &objects[i];
+        for(uint32_t j = 0; j < object->line_count; ++j) {
+            char buf[MAX_LINE_LEN];
+            strcpy(buf, object->lines[j]);
+
+            char* line_contents[MAX_LINE_ELEMENTS];
+            uint32_t line_elem_counter = split_line(buf, line_contents, MAX_LINE_ELEMENTS);
+
+            if(line_elem_counter < 2 || (strcmp(line_contents[0], "jmp") != 0 && strcmp(line_contents[0], "jz") != 0)) {
+                add_to_program_memory(machine, object->lines[j]);
+                continue;
+            }
+
+            // targets are lines of the module that holds them, a jump never runs off
+            // the end of one module into the next
+            unsigned long index;
+            const symbol_t* symbol;
+            const object_t* owner = object;
+            if(is_number(line_contents[1])) {
+                // saturates on overflow instead of wrapping into range
+                index = strtoul(line_contents[1], NULL, 10);
+            } else if((symbol = find_symbol(object, line_contents[1])) != NULL) {
+                index = symbol->index;
+            } else if((symbol = find_global(objects, n, line_contents[1], &owner)) != NULL) {
+                index = symbol->index;
+            } else {
+                fprintf(stderr, "[-] link_objects() : %s: undefined label `%s`\n", object->source_path, line_contents[1]);
+                ++err_counter;
+                continue;
+            }
+
+            if(index >= owner->line_count) {
+                fprintf(stderr, "[-] link_objects() : %s: jump target `%s` is past the end of %s\n", object->source_path, line_contents[1], owner->source_path);
+                ++err_counter;
+                continue;
+            }
+            // the image fits MAX_PROGRAM_LINES, so this is always in pc range
+            uint32_t target = owner->base + (uint32_t)index;
+
+            char line[MAX_LINE_LEN];
+            snprintf(line, MAX_LINE_LEN, "%s %u", line_contents[0], target);
+            add_to_program_memory(machine, line);
+        }
+    }
+
+    // never leave a half-linked image behind
+    if(err_counter != 0) {
+        clear_program_memory(machine);
+    }
+    return err_counter;
+}
+
+uint32_t load_program(machine_t* machine, const char* source) {
+    object_t* object = calloc(1, sizeof(object_t));
+    if(object == NULL) {
+        fprintf(stderr, "[-] load_program() : out of memory\n");
+        return 1;
+    }
+    strcpy(object->source_path, "<memory>");
+
+    uint32_t err_counter = assemble_buffer(object, source);
+    if(err_counter == 0 && object->include_count != 0) {
+        fprintf(stderr, "[-] load_program() : `include` needs build_program()\n");
+        ++err_counter;
+    }
+    if(err_counter == 0) {
+        clear_program_memory(machine);
+        err_counter = link_objects(machine, object, 1);
+    }
+
+    free_object(object);
+    free(object);
+    return err_counter;
+}
+
+static uint32_t add_module(object_t* objects, uint32_t* count, const char* source_dir, const char* name) {
+    char path[MAX_PATH_LEN];
+    if(strlen(source_dir) + strlen(name) >= MAX_PATH_LEN) {
+        fprintf(stderr, "[-] build_program() : source path too long: %s%s\n", source_dir, name);
+        return 1;
+    }
+    strcpy(path, source_dir);
+    strcat(path, name);
+
+    for(uint32_t i = 0; i < *count; ++i) {
+        if(strcmp(objects[i].source_path, path) == 0) {
+            return 0;
+        }
+    }
+    if(*count >= MAX_MODULES) {
+        fprintf(stderr, "[-] build_program() : too many modules (max. %d)\n", MAX_MODULES);
+        return 1;
+    }
+    strcpy(objects[(*count)++].source_path, path);
+    return 0;
+}
+
+uint32_t build_program(machine_t* machine, const char* source_dir, char** source_file_names, uint32_t n) {
+    uint32_t err_counter = 0;
+    object_t* objects = calloc(MAX_MODULES, sizeof(object_t));
+    if(objects == NULL) {
+        fprintf(stderr, "[-] build_program() : out of memory\n");
+        return 1;
+    }
+
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < n; ++i) {
+        err_counter += add_module(objects, &count, source_dir, source_file_names[i]);
+    }
+
+    // includes are only known after a file is assembled, so assemble in waves
+    uint32_t assembled = 0;
+    while(assembled < count && err_counter == 0) {
+        uint32_t wave_end = count;
+        assemble_parallel(objects + assembled, wave_end - assembled, machine->is_verbose);
+
+        for(uint32_t i = assembled; i < wave_end; ++i) {
+            err_counter += objects[i].err_counter;
+            for(uint32_t j = 0; j < objects[i].include_count; ++j) {
+                err_counter += add_module(objects, &count, source_dir, objects[i].includes[j]);
+            }
+        }
+        assembled = wave_end;
+    }
+
+    // like load_program(), a successful build replaces the program memory
+    if(err_counter == 0) {
+        clear_program_memory(machine);
+        err_counter = link_objects(machine, objects, count);
+    }
+
+    for(uint32_t i = 0; i < count; ++i) {
+        free_object(&objects[i]);
+    }
+    free(objects);
+
+    return err_counter;
+}
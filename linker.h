@@ -0,0 +1,79 @@
+/*
+
+    linker.h - Multi-file assembly
+
+    Every source file is assembled into a relocatable object, which holds the
+    file's instruction lines, the labels it defines and the modules it includes.
+    Objects are cached next to their source (name.kyobj) and a file is only
+    reassembled when it is newer than its object. Files are assembled in parallel,
+    then the linker concatenates the objects into a single program image and
+    resolves the jmp/jz targets.
+
+    Source syntax:
+        name:                   define label `name` at the next instruction
+        global name             export label `name` to the other modules
+        include file.kyasm      link file.kyasm into the program image
+        jmp name / jz name      jump to a label (local first, then global)
+        jmp 4 / jz 4            jump to a line, relative to the module start
+
+    A jump target has to be a line of its own module, so a numeric target past the
+    module's last line, or a label with no instruction after it, is a link error
+    instead of falling through into the next module.
+
+    The first module given is placed at address 0 and is where execution starts.
+    pc is 8 bit, so a linked image holds at most MAX_PROGRAM_LINES lines.
+
+*/
+
+#ifndef LINKER_H_
+#define LINKER_H_
+
+#include "machine.h"
+
+#define MAX_MODULES 64
+#define MAX_SYMBOLS 256
+#define MAX_SYMBOL_LEN 32
+#define MAX_PATH_LEN 260
+#define MAX_ASSEMBLER_THREADS 16
+#define OBJECT_FILE_EXT ".kyobj"
+#define OBJECT_FILE_VERSION 2
+
+typedef struct symbol {
+    char name[MAX_SYMBOL_LEN];
+    uint32_t index;
+    int is_global;
+} symbol_t;
+
+typedef struct object {
+    char source_path[MAX_PATH_LEN];
+    char object_path[MAX_PATH_LEN];
+
+    char* lines[MAX_PROGRAM_LINES];
+    uint32_t line_count;
+
+    symbol_t symbols[MAX_SYMBOLS];
+    uint32_t symbol_count;
+
+    char includes[MAX_MODULES][MAX_PATH_LEN];
+    uint32_t include_count;
+
+    // address of the first line in the linked image
+    uint32_t base;
+    // 1 if loaded from an up-to-date object file instead of being reassembled
+    int is_cached;
+
+    uint32_t err_counter;
+} object_t;
+
+uint32_t assemble_buffer(object_t* object, const char* source);
+uint32_t assemble_file(object_t* object, const char* source_path);
+uint32_t write_object(const object_t* object);
+uint32_t load_object(object_t* object);
+void free_object(object_t* object);
+uint32_t link_objects(machine_t* machine, object_t* objects, uint32_t n);
+// assemble and link modules under source_dir, replacing the program memory
+uint32_t build_program(machine_t* machine, const char* source_dir, char** source_file_names, uint32_t n);
+// assemble and link a single module held in memory, replacing the program memory
+KYEMU_API uint32_t load_program(machine_t* machine, const char* source);
+
+#endif
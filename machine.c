@@ -1,9 +1,182 @@
 #include "machine.h"
 
+#include <errno.h>
+#include <string.h>
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+static const char* opcode_names[OP_COUNT] = {
+    "mov", "cmp", "jmp", "jz", "pop", "push", "lea", "nop", "hlt", "end",
+    "add", "sub", "mul", "div", "fill", "copy", "mcmp", NULL
+};
+
+const uint8_t cycle_costs[OP_COUNT] = {
+    [OP_MOV] = 7, [OP_CMP] = 4, [OP_JMP] = 10, [OP_JZ] = 10, [OP_POP] = 10, [OP_PUSH] = 11,
+    [OP_LEA] = 5, [OP_NOP] = 4, [OP_HLT] = 7, [OP_END] = 7,
+    [OP_ADD] = 4, [OP_SUB] = 4, [OP_MUL] = 8, [OP_DIV] = 16,
+    [OP_FILL] = 10, [OP_COPY] = 10, [OP_MCMP] = 10, [OP_UNKNOWN] = 4
+};
+
+machine_t* create_machine(void) {
+    machine_t* machine = (machine_t*) calloc(1, sizeof(machine_t));
+    if(machine == NULL) {
+        fprintf(stderr, "[-] create_machine() : out of memory\n");
+    }
+    return machine;
+}
+
+void destroy_machine(machine_t* machine) {
+    if(machine == NULL) {
+        return;
+    }
+    clear_program_memory(machine);
+    close_stats_segment(machine->stats_segment);
+    free(machine);
+}
+
+void set_halt_callback(machine_t* machine, halt_callback_t callback, void* user_data) {
+    machine->halt_callback = callback;
+    machine->halt_user_data = user_data;
+}
+
+void set_fault_callback(machine_t* machine, fault_callback_t callback, void* user_data) {
+    machine->fault_callback = callback;
+    machine->fault_user_data = user_data;
+}
+
+// count an error, then let the fault callback decide whether run_for() stops
+void raise_fault(machine_t* machine, const char* message) {
+    ++machine->err_counter;
+    if(machine->fault_callback != NULL) {
+        if(machine->fault_callback(machine, machine->pc, message, machine->fault_user_data) != 0) {
+            machine->is_stop_requested = 1;
+        }
+    } else {
+        fprintf(stderr, "%s\n", message);
+    }
+}
+
+uint32_t split_line(char* line, char** tokens, uint32_t max_tokens) {
+    uint32_t n = 0;
+    char* c = line;
+    while(*c != 0 && n < max_tokens) {
+        while(*c == ' ' || *c == '\t') {
+            *c++ = 0;
+        }
+        if(*c == 0) {
+            break;
+        }
+        tokens[n++] = c;
+        while(*c != 0 && *c != ' ' && *c != '\t') {
+            ++c;
+        }
+    }
+    return n;
+}
+
+uint32_t get_core_count(void) {
+#ifdef __unix__
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (uint32_t)n : 1;
+#else
+    return 4;
+#endif
+}
+
 void set_verbosity(machine_t* machine, int verbosity) {
     machine->is_verbose = verbosity;
 }
 
+void set_clock_frequency(machine_t* machine, uint32_t hz) {
+    machine->clock_hz = hz;
+}
+
+OPCODES get_opcode(const char* name) {
+    for(uint32_t i = 0; i < OP_UNKNOWN; ++i) {
+        if(strcmp(name, opcode_names[i]) == 0) {
+            return (OPCODES)i;
+        }
+    }
+    return OP_UNKNOWN;
+}
+
+uint64_t get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// emulated time of `cycles` at `hz`, split to not overflow on long runs
+static uint64_t cycles_to_ns(uint64_t cycles, uint32_t hz) {
+    return (cycles / hz) * 1000000000ull + (cycles % hz) * 1000000000ull / hz;
+}
+
+static void sleep_until_ns(uint64_t deadline) {
+#ifdef __unix__
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ull;
+    ts.tv_nsec = deadline % 1000000000ull;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+#else
+    uint64_t now = get_time_ns();
+    if(now < deadline) {
+        struct timespec ts;
+        ts.tv_sec = (deadline - now) / 1000000000ull;
+        ts.tv_nsec = (deadline - now) % 1000000000ull;
+        while(nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+    }
+#endif
+}
+
+// value of a `$reg` or literal operand
+static uint32_t get_operand(machine_t* machine, const char* operand) {
+    if(!strcmp(operand, "$ax")) {
+        return get_reg(machine, ax);
+    } else if(!strcmp(operand, "$bx")) {
+        return get_reg(machine, bx);
+    } else if(!strcmp(operand, "$cx")) {
+        return get_reg(machine, cx);
+    } else if(!strcmp(operand, "$dx")) {
+        return get_reg(machine, dx);
+    }
+    return atoi(operand);
+}
+
+// copy the local counters to the shared segment, relaxed stores are enough for a monitor
+static void publish_stats(machine_t* machine) {
+    stats_segment_t* segment = machine->stats_segment;
+    uint64_t now = get_time_ns();
+
+    // publishes can come close together (run_for() publishes when it returns), the rate
+    // keeps its last value until a whole window has passed
+    if(machine->stats_publish_ns == 0) {
+        machine->stats_publish_ns = now;
+        machine->stats_publish_instructions = machine->stats.instructions;
+    } else if(now - machine->stats_publish_ns >= STATS_RATE_WINDOW_NS) {
+        uint64_t executed = machine->stats.instructions - machine->stats_publish_instructions;
+        atomic_store_explicit(&segment->instructions_per_sec, executed * 1000000000ull / (now - machine->stats_publish_ns), memory_order_relaxed);
+        machine->stats_publish_ns = now;
+        machine->stats_publish_instructions = machine->stats.instructions;
+    }
+
+    atomic_store_explicit(&segment->instructions, machine->stats.instructions, memory_order_relaxed);
+    atomic_store_explicit(&segment->branches, machine->stats.branches, memory_order_relaxed);
+    atomic_store_explicit(&segment->memory_reads, machine->stats.memory_reads, memory_order_relaxed);
+    atomic_store_explicit(&segment->memory_writes, machine->stats.memory_writes, memory_order_relaxed);
+    atomic_store_explicit(&segment->stack_high_water, machine->stats.stack_high_water, memory_order_relaxed);
+    atomic_store_explicit(&segment->errors, machine->err_counter, memory_order_relaxed);
+    atomic_store_explicit(&segment->publish_time_ns, now, memory_order_relaxed);
+}
+
+// sleep until the host clock catches up with the emulated one, both counted from the start of this run
+static void pace(machine_t* machine, uint64_t start_ns, uint64_t start_cycles) {
+    uint64_t deadline = start_ns + cycles_to_ns(machine->cycles - start_cycles, machine->clock_hz);
+    if(get_time_ns() < deadline) {
+        sleep_until_ns(deadline);
+    }
+}
+
 void reset(machine_t* machine) {
     memset(machine->general_memory, 0, sizeof(machine->general_memory));
     memset(machine->stack, 0, sizeof(machine->stack));
@@ -17,6 +190,13 @@ void reset(machine_t* machine) {
     machine->fl = 0;
 
     machine->halt = 0;
+    machine->err_counter = 0;
+    machine->cycles = 0;
+    machine->drift_ns = 0;
+
+    memset(&machine->stats, 0, sizeof(machine->stats));
+    machine->stats_publish_ns = 0;
+    machine->stats_publish_instructions = 0;
 }
 
 void store_to_reg(machine_t* machine, REGS reg, uint8_t value) {
@@ -35,6 +215,20 @@ void store_to_reg(machine_t* machine, REGS reg, uint8_t value) {
     machine->pc++;
 }
 
+void set_reg(machine_t* machine, enum REGS reg, uint8_t value) {
+    switch(reg) {
+        case ax: machine->ax = value; break;
+        case bx: machine->bx = value; break;
+        case cx: machine->cx = value; break;
+        case dx: machine->dx = value; break;
+        case sp: machine->sp = value; break;
+        case bp: machine->bp = value; break;
+        case pc: machine->pc = value; break;
+        case fl: machine->fl = value; break;
+        default: fprintf(stderr, "[-] set_reg() : invalid register identifier\n");
+    }
+}
+
 void add_to_register(machine_t* machine, enum REGS reg, uint8_t value) {
     switch(reg) {
         case ax: machine->ax += value; break;
@@ -72,6 +266,11 @@ void mul_to_register(machine_t* machine, enum REGS reg, uint8_t value) {
 }
 
 void div_to_register(machine_t* machine, enum REGS reg, uint8_t value) {
+    if(value == 0) {
+        raise_fault(machine, "[-] div_to_register() : division by zero");
+        machine->pc++;
+        return;
+    }
     switch(reg) {
         case ax: machine->ax /= value; break;
         case bx: machine->bx /= value; break;
@@ -84,11 +283,13 @@ void div_to_register(machine_t* machine, enum REGS reg, uint8_t value) {
 }
 
 uint32_t jump(machine_t* machine, uint32_t addr) {
+    machine->stats.branches++;
     machine->pc = addr;
     return machine->pc;
 }
 
 uint32_t jump_if_not_zero(machine_t* machine, uint32_t addr) {
+    machine->stats.branches++;
     if(machine->fl != 0) {
         machine->pc = addr;
     } else {
@@ -101,9 +302,12 @@ uint32_t jump_if_not_zero(machine_t* machine, uint32_t addr) {
 
 void poke(machine_t* machine, uint32_t addr, uint8_t value) {
     if(addr < 0 || addr >= GEN_MEM_CAPACITY) {
-        fprintf(stderr, "[-] poke() : invalid memory address\n");
+        raise_fault(machine, "[-] poke() : invalid memory address");
+        machine->pc++;
+        return;
     }
     machine->general_memory[addr] = value;
+    machine->stats.memory_writes++;
     machine->pc++;
 
 }
@@ -117,6 +321,114 @@ uint8_t peek(const machine_t* machine, uint32_t addr) {
 
 }
 
+static int is_valid_range(uint32_t addr, uint32_t len) {
+    return addr < GEN_MEM_CAPACITY && len <= GEN_MEM_CAPACITY - addr;
+}
+
+// the block operations go through the C library, whose mem* routines are vectorized
+uint32_t fill_memory(machine_t* machine, uint32_t addr, uint32_t len, uint8_t value) {
+    if(!is_valid_range(addr, len)) {
+        raise_fault(machine, "[-] fill_memory() : invalid memory range");
+        machine->pc++;
+        return 1;
+    }
+    memset(machine->general_memory + addr, value, len);
+    machine->stats.memory_writes += len;
+    machine->cycles += (uint64_t)len * BLOCK_CYCLES_PER_BYTE;
+    machine->pc++;
+    return 0;
+}
+
+uint32_t copy_memory(machine_t* machine, uint32_t dst, uint32_t src, uint32_t len) {
+    if(!is_valid_range(dst, len) || !is_valid_range(src, len)) {
+        raise_fault(machine, "[-] copy_memory() : invalid memory range");
+        machine->pc++;
+        return 1;
+    }
+    // ranges may overlap
+    memmove(machine->general_memory + dst, machine->general_memory + src, len);
+    machine->stats.memory_reads += len;
+    machine->stats.memory_writes += len;
+    machine->cycles += (uint64_t)len * BLOCK_CYCLES_PER_BYTE;
+    machine->pc++;
+    return 0;
+}
+
+// sets fl to 1 if the two ranges are equal, 0 otherwise
+uint32_t compare_memory(machine_t* machine, uint32_t addr_1, uint32_t addr_2, uint32_t len) {
+    if(!is_valid_range(addr_1, len) || !is_valid_range(addr_2, len)) {
+        raise_fault(machine, "[-] compare_memory() : invalid memory range");
+        machine->pc++;
+        return 1;
+    }
+    machine->fl = memcmp(machine->general_memory + addr_1, machine->general_memory + addr_2, len) == 0;
+    machine->stats.memory_reads += 2 * (uint64_t)len;
+    machine->cycles += (uint64_t)len * BLOCK_CYCLES_PER_BYTE;
+    machine->pc++;
+    return 0;
+}
+
+uint32_t get_pair_address(machine_t* machine, enum REGS hi, enum REGS lo) {
+    return (uint32_t)get_reg(machine, hi) << 8 | get_reg(machine, lo);
+}
+
+// a register pair can address all of general memory and nothing past it, so [hi:lo]
+// never needs a bound check and [hi:lo+] at the last byte wraps to 0
+_Static_assert(GEN_MEM_CAPACITY == UINT16_MAX + 1, "register pairs must span general memory exactly");
+
+// 16 bit increment, lo carries into hi
+static void increment_pair(machine_t* machine, enum REGS hi, enum REGS lo) {
+    uint32_t addr = get_pair_address(machine, hi, lo) + 1;
+    set_reg(machine, hi, addr >> 8);
+    set_reg(machine, lo, addr);
+}
+
+void load_address(machine_t* machine, enum REGS hi, enum REGS lo, uint32_t addr) {
+    if(addr >= GEN_MEM_CAPACITY) {
+        raise_fault(machine, "[-] load_address() : invalid memory address");
+        machine->pc++;
+        return;
+    }
+    set_reg(machine, hi, addr >> 8);
+    set_reg(machine, lo, addr);
+    machine->pc++;
+}
+
+// the destination is written after the increment, so it wins if it is part of the pair
+void load_indirect(machine_t* machine, enum REGS reg, enum REGS hi, enum REGS lo, int is_increment) {
+    uint8_t value = peek(machine, get_pair_address(machine, hi, lo));
+    machine->stats.memory_reads++;
+    if(is_increment) {
+        increment_pair(machine, hi, lo);
+    }
+    store_to_reg(machine, reg, value);
+}
+
+void store_indirect(machine_t* machine, enum REGS hi, enum REGS lo, uint8_t value, int is_increment) {
+    poke(machine, get_pair_address(machine, hi, lo), value);
+    if(is_increment) {
+        increment_pair(machine, hi, lo);
+    }
+}
+
+uint32_t read_memory(const machine_t* machine, uint32_t addr, uint8_t* dst, uint32_t len) {
+    if(!is_valid_range(addr, len)) {
+        fprintf(stderr, "[-] read_memory() : invalid memory range\n");
+        return 1;
+    }
+    memcpy(dst, machine->general_memory + addr, len);
+    return 0;
+}
+
+uint32_t write_memory(machine_t* machine, uint32_t addr, const uint8_t* src, uint32_t len) {
+    if(!is_valid_range(addr, len)) {
+        fprintf(stderr, "[-] write_memory() : invalid memory range\n");
+        return 1;
+    }
+    memcpy(machine->general_memory + addr, src, len);
+    return 0;
+}
+
 void poke_stack(machine_t* machine, uint32_t addr, uint8_t value) {
     if(addr < 0 || addr >= STACK_CAPACITY) {
         fprintf(stderr, "[-] poke_stack() : invalid memory address\n");
@@ -125,62 +437,30 @@ void poke_stack(machine_t* machine, uint32_t addr, uint8_t value) {
     machine->pc++;
 }
 
-uint32_t get_stack_bottom(machine_t* machine) {
-    uint32_t i = 0;
-    while(machine->stack[i] != 0) {
-        ++i;
-    }
-    machine->sp = i + 1;
-    return i + 1;
-}
-
+// sp counts the values on the stack, push writes stack[sp++], pop reads stack[--sp]
 void pop_stack(machine_t* machine, enum REGS reg) {
-    switch(reg) {
-        case ax: {
-            machine->ax = machine->stack[get_stack_bottom(machine)];
-            machine->stack[get_stack_bottom(machine)] = 0;
-        }
-        case bx: {
-            machine->bx = machine->stack[get_stack_bottom(machine)];
-            machine->stack[get_stack_bottom(machine)] = 0;
-        }
-        case cx: {
-            machine->cx = machine->stack[get_stack_bottom(machine)];
-            machine->stack[get_stack_bottom(machine)] = 0;
-        }
-        case dx: {
-            machine->dx = machine->stack[get_stack_bottom(machine)];
-            machine->stack[get_stack_bottom(machine)] = 0;
-        }
-        default: {
-            fprintf(stderr, "[-] pop() : invalid register argument!\n");
-        }
+    if(reg < ax || reg > dx) {
+        raise_fault(machine, "[-] pop() : invalid register argument!");
+    } else if(machine->sp == 0) {
+        raise_fault(machine, "[-] pop() : stack underflow");
+    } else {
+        machine->sp--;
+        set_reg(machine, reg, machine->stack[machine->sp]);
     }
-
-    get_stack_bottom(machine);
     machine->pc++;
 }
+
 void push_stack(machine_t* machine, enum REGS reg) {
-    uint32_t stack_bottom = get_stack_bottom(machine);
-    switch(reg) {
-        case ax: {
-            machine->stack[stack_bottom] = machine->ax;
-        }
-        case bx: {
-            machine->stack[stack_bottom] = machine->bx;
-        }
-        case cx: {
-            machine->stack[stack_bottom] = machine->cx;
-        }
-        case dx: {
-            machine->stack[stack_bottom] = machine->dx;
-        }
-        default: {
-            fprintf(stderr, "[-] push() : invalid register argument!\n");
+    if(reg < ax || reg > dx) {
+        raise_fault(machine, "[-] push() : invalid register argument!");
+    } else if(machine->sp >= STACK_DEPTH) {
+        raise_fault(machine, "[-] push() : stack overflow");
+    } else {
+        machine->stack[machine->sp++] = get_reg(machine, reg);
+        if(machine->sp > machine->stats.stack_high_water) {
+            machine->stats.stack_high_water = machine->sp;
         }
     }
-
-    get_stack_bottom(machine);
     machine->pc++;
 }
 
@@ -193,39 +473,54 @@ uint8_t peek_stack(const machine_t* machine, uint32_t addr) {
     return machine->stack[addr];
 }
 
-void compare(machine_t* machine, char* reg_1, char* reg_2) {
-    if((strcmp(reg_1, "ax") == 0 && strcmp(reg_2, "bx") == 0) || (strcmp(reg_1, "bx") == 0 && strcmp(reg_2, "ax") == 0)) {
-        if(machine->ax == machine->bx) {
-            machine->fl = 1;
-        }
+// register named by an operand, -1 if it isn't one of the general purpose registers
+int parse_reg(const char* name) {
+    if(strcmp(name, "ax") == 0) {
+        return ax;
+    } else if(strcmp(name, "bx") == 0) {
+        return bx;
+    } else if(strcmp(name, "cx") == 0) {
+        return cx;
+    } else if(strcmp(name, "dx") == 0) {
+        return dx;
     }
+    return -1;
+}
 
-    if((strcmp(reg_1, "ax") == 0 && strcmp(reg_2, "cx") == 0) || (strcmp(reg_1, "cx") == 0 && strcmp(reg_2, "ax") == 0)) {
-        if(machine->ax == machine->cx) {
-            machine->fl = 1;
-        }
+// `hi:lo`, two different general purpose registers
+uint32_t parse_reg_pair(const char* text, int* hi, int* lo) {
+    char buf[8];
+    const char* sep = strchr(text, ':');
+    if(sep == NULL || sep - text >= (long)sizeof(buf)) {
+        return 1;
     }
+    memcpy(buf, text, sep - text);
+    buf[sep - text] = 0;
+    *hi = parse_reg(buf);
+    *lo = parse_reg(sep + 1);
+    return *hi < 0 || *lo < 0 || *hi == *lo;
+}
 
-    if((strcmp(reg_1, "ax") == 0 && strcmp(reg_2, "dx") == 0) || (strcmp(reg_1, "dx") == 0 && strcmp(reg_2, "ax") == 0)) {
-        if(machine->ax == machine->dx) {
-            machine->fl = 1;
-        }
+// `[hi:lo]`, or `[hi:lo+]` which advances the pair after the access
+uint32_t parse_indirect(const char* text, int* hi, int* lo, int* is_increment) {
+    char buf[16];
+    size_t len = strlen(text);
+    if(len < 3 || len >= sizeof(buf) || text[0] != '[' || text[len-1] != ']') {
+        return 1;
     }
-
-    if((strcmp(reg_1, "bx") == 0 && strcmp(reg_2, "cx") == 0) || (strcmp(reg_1, "cx") == 0 && strcmp(reg_2, "bx") == 0)) {
-        if(machine->bx == machine->cx) {
-            machine->fl = 1;
-        }
-    }
-
-    if((strcmp(reg_1, "cx") == 0 && strcmp(reg_2, "dx") == 0) || (strcmp(reg_1, "dx") == 0 && strcmp(reg_2, "cx") == 0)) {
-        if(machine->cx == machine->dx) {
-            machine->fl = 1;
-        }
+    memcpy(buf, text + 1, len - 2);
+    buf[len - 2] = 0;
+    *is_increment = buf[len - 3] == '+';
+    if(*is_increment) {
+        buf[len - 3] = 0;
     }
+    return parse_reg_pair(buf, hi, lo);
+}
 
-    if((strcmp(reg_1, "bx") == 0 && strcmp(reg_2, "dx") == 0) || (strcmp(reg_1, "dx") == 0 && strcmp(reg_2, "bx") == 0)) {
-        if(machine->bx == machine->dx) {
+// sets fl if two different general purpose registers are equal, other pairs are ignored
+void compare_regs(machine_t* machine, int reg_1, int reg_2) {
+    if(reg_1 >= 0 && reg_2 >= 0 && reg_1 != reg_2) {
+        if(get_reg(machine, reg_1) == get_reg(machine, reg_2)) {
             machine->fl = 1;
         }
     }
@@ -233,6 +528,10 @@ void compare(machine_t* machine, char* reg_1, char* reg_2) {
     machine->pc++;
 }
 
+void compare(machine_t* machine, char* reg_1, char* reg_2) {
+    compare_regs(machine, parse_reg(reg_1), parse_reg(reg_2));
+}
+
 void halt(machine_t* machine) {
     // TODO: halt
     machine->halt = 1;
@@ -287,7 +586,7 @@ uint8_t get_reg(machine_t* machine, enum REGS reg) {
 }
 
 void no_op(machine_t* machine) {
-    return;
+    machine->pc++;
 }
 
 void show_screen_output(machine_t* machine) {
@@ -305,11 +604,22 @@ void print_memory(machine_t* machine, uint32_t n, uint32_t m) {
     }
 }
 
-void add_to_program_memory(machine_t* machine, char* line) {
+void clear_program_memory(machine_t* machine) {
+    for(uint32_t i = 0; i < PROGRAM_MEM_CAPACITY; ++i) {
+        free(machine->program_memory[i]);
+        machine->program_memory[i] = NULL;
+    }
+}
+
+void add_to_program_memory(machine_t* machine, const char* line) {
     uint32_t i = 0;
-    while(machine->program_memory[i] != NULL) {
+    while(i < PROGRAM_MEM_CAPACITY && machine->program_memory[i] != NULL) {
         ++i;
     }
+    if(i == PROGRAM_MEM_CAPACITY) {
+        fprintf(stderr, "[-] add_to_program_memory() : program memory is full\n");
+        return;
+    }
     machine->program_memory[i] = malloc(strlen(line)+1);
     strcpy(machine->program_memory[i], line);
     #ifdef _DEBUG_
@@ -317,6 +627,343 @@ void add_to_program_memory(machine_t* machine, char* line) {
     #endif
 }
 
+// execute the instruction at pc, the caller makes sure pc points into the program
+static OPCODES execute_instruction(machine_t* machine) {
+    char buf[MAX_LINE_LEN];
+    snprintf(buf, MAX_LINE_LEN, "%s", machine->program_memory[machine->pc]);
+    #ifdef _DEBUG_
+    printf("EXECUTE_CODE BUF: %s , machine->pc = %d\n", buf, machine->pc);
+    #endif
+    char* line_contents[MAX_LINE_ELEMENTS];
+
+    _Bool is_unknown_instr = false; 
+    
+    // tokenize line, missing operands read as empty strings
+    uint8_t line_elem_counter = split_line(buf, line_contents, MAX_LINE_ELEMENTS);
+    for(uint32_t i = line_elem_counter; i < 4; ++i) {
+        line_contents[i] = "";
+    }
+
+    OPCODES op = get_opcode(line_contents[0]);
+
+    // interpret tokenized form, assume there is no line with more than 50 words
+    if(op == OP_MOV && (line_contents[1][0] == '[' || line_contents[2][0] == '[')) {
+        // register-pair indirect: mov reg [hi:lo], mov [hi:lo] value, `+` advances the pair
+        int hi, lo, is_increment;
+        if(parse_reg(line_contents[1]) >= 0 && parse_indirect(line_contents[2], &hi, &lo, &is_increment) == 0) {
+            load_indirect(machine, parse_reg(line_contents[1]), hi, lo, is_increment);
+        } else if(line_contents[2][0] != '[' && parse_indirect(line_contents[1], &hi, &lo, &is_increment) == 0) {
+            store_indirect(machine, hi, lo, get_operand(machine, line_contents[2]), is_increment);
+        } else {
+            raise_fault(machine, " [-] - invalid `mov` instruction arguments!");
+            machine->pc++;
+        }
+    } else if(op == OP_MOV) {
+        uint8_t val;
+         if(!strcmp(line_contents[2], "$ax")) {
+            val = get_reg(machine, ax);
+        } else if(!strcmp(line_contents[2], "$bx")) {
+            val = get_reg(machine, bx);
+        } else if(!strcmp(line_contents[2], "$cx")) {
+            val = get_reg(machine, cx);
+        } else if(!strcmp(line_contents[2], "$dx")) {
+            val = get_reg(machine, dx);
+        } else {
+            val = atoi(line_contents[2]);
+        }
+        if(sizeof(val) != sizeof(uint32_t) && sizeof(val) != sizeof(uint8_t)) {
+            raise_fault(machine, " [-](mov) invalid instruction argument! (operand)");
+        }
+        // mov instr -> check for arguments
+        if(strcmp(line_contents[1], "ax") == 0) {
+            store_to_reg(machine, ax, val);
+        } else if(strcmp(line_contents[1], "bx") == 0) {
+            store_to_reg(machine, bx, val);
+        } else if(strcmp(line_contents[1], "cx") == 0) {
+            store_to_reg(machine, cx, val);
+        } else if(strcmp(line_contents[1], "dx") == 0) {
+            store_to_reg(machine, dx, val);
+
+        } else if(line_contents[1][0] == '%') {
+            // memory locations marked with %
+            uint32_t memory_addr = atoi(line_contents[1] + 1);
+            poke(machine, memory_addr, val);
+        
+        } else {
+            raise_fault(machine, " [-] - invalid `mov` instruction arguments!");
+            machine->pc++;
+        }
+
+    } else if(op == OP_CMP) {
+        compare(machine, line_contents[1], line_contents[2]);
+    } else if(op == OP_JMP) {
+        jump(machine, atoi(line_contents[1]));
+    } else if(op == OP_JZ) {
+        jump_if_not_zero(machine, atoi(line_contents[1]));
+    } else if(op == OP_POP) {
+        // first argument is the specified register
+        if(strcmp(line_contents[1], "ax") == 0) {
+            pop_stack(machine, ax);
+        } else if(strcmp(line_contents[1], "bx") == 0) {
+            pop_stack(machine, bx);
+        } else if(strcmp(line_contents[1], "cx") == 0) {
+            pop_stack(machine, cx);
+        } else if(strcmp(line_contents[1], "dx") == 0) {
+            pop_stack(machine, dx);
+        } else {
+            raise_fault(machine, " [-](pop) invalid instruction argument! (register)");
+            machine->pc++;
+        }
+    } else if(op == OP_PUSH) {
+        if(strcmp(line_contents[1], "ax") == 0) {
+            push_stack(machine, ax);
+        } else if(strcmp(line_contents[1], "bx") == 0) {
+            push_stack(machine, bx);
+        } else if(strcmp(line_contents[1], "cx") == 0) {
+            push_stack(machine, cx);
+        } else if(strcmp(line_contents[1], "dx") == 0) {
+            push_stack(machine, dx);
+        } else {
+            raise_fault(machine, " [-](push) invalid instruction argument! (register)");
+            machine->pc++;
+        }
+    } else if(op == OP_LEA) {
+        // lea hi:lo %addr
+        int hi, lo;
+        if(parse_reg_pair(line_contents[1], &hi, &lo) != 0 || line_contents[2][0] != '%') {
+            raise_fault(machine, " [-] - invalid `lea` instruction arguments!");
+            machine->pc++;
+        } else {
+            load_address(machine, hi, lo, atoi(line_contents[2] + 1));
+        }
+    } else if(op == OP_FILL || op == OP_COPY || op == OP_MCMP) {
+        // fill %addr <len> <value>, copy %dst %src <len>, mcmp %addr %addr <len>
+        if(line_elem_counter < 4 || line_contents[1][0] != '%' || (op != OP_FILL && line_contents[2][0] != '%')) {
+            raise_fault(machine, " [-] - invalid block instruction arguments!");
+            machine->pc++;
+        } else if(op == OP_FILL) {
+            fill_memory(machine, atoi(line_contents[1] + 1), get_operand(machine, line_contents[2]), get_operand(machine, line_contents[3]));
+        } else if(op == OP_COPY) {
+            copy_memory(machine, atoi(line_contents[1] + 1), atoi(line_contents[2] + 1), get_operand(machine, line_contents[3]));
+        } else {
+            compare_memory(machine, atoi(line_contents[1] + 1), atoi(line_contents[2] + 1), get_operand(machine, line_contents[3]));
+        }
+    } else if(op == OP_NOP) {
+        // NOTHING - most useful instruction ever
+        // has to be included because of nop slides
+        no_op(machine);
+    } else if(op == OP_HLT) {
+        halt(machine);
+    } else if(op == OP_END) {
+        halt(machine);
+        
+    } else if(op == OP_ADD) {
+        uint8_t val;
+             // get val from get_reg
+        if(!strcmp(line_contents[2], "$ax")) {
+            val = get_reg(machine, ax);
+        } else if(!strcmp(line_contents[2], "$bx")) {
+            val = get_reg(machine, bx);
+        } else if(!strcmp(line_contents[2], "$cx")) {
+            val = get_reg(machine, cx);
+        } else if(!strcmp(line_contents[2], "$dx")) {
+            val = get_reg(machine, dx);
+        } else {
+            val = atoi(line_contents[2]);
+        }
+         
+         if(sizeof(val) != sizeof(uint32_t) && sizeof(val) != sizeof(uint8_t)) {
+            raise_fault(machine, " [-](add) invalid instruction argument! (operand)");
+        }
+         if(!strcmp(line_contents[1], "ax")) {
+            add_to_register(machine, ax, val);
+         } else if(!strcmp(line_contents[1], "bx")) {
+            add_to_register(machine, bx, val);
+         } else if(!strcmp(line_contents[1], "cx")) {
+            add_to_register(machine, cx, val);
+         } else if(!strcmp(line_contents[1], "dx")) {
+            add_to_register(machine, dx, val);
+         } 
+         else {
+             raise_fault(machine, " [-](add) invalid instruction argument! (register)");
+             machine->pc++;
+         }
+    } else if(op == OP_SUB) {
+        uint8_t val;
+         if(!strcmp(line_contents[2], "$ax")) {
+            val = get_reg(machine, ax);
+        } else if(!strcmp(line_contents[2], "$bx")) {
+            val = get_reg(machine, bx);
+        } else if(!strcmp(line_contents[2], "$cx")) {
+            val = get_reg(machine, cx);
+        } else if(!strcmp(line_contents[2], "$dx")) {
+            val = get_reg(machine, dx);
+        } else {
+            val = atoi(line_contents[2]);
+        }
+        if(sizeof(val) != sizeof(uint32_t) && sizeof(val) != sizeof(uint8_t)) {
+            raise_fault(machine, " [-](sub) invalid instruction argument! (operand)");
+        }
+         if(!strcmp(line_contents[1], "ax")) {
+            sub_to_register(machine, ax, val);
+         } else if(!strcmp(line_contents[1], "bx")) {
+            sub_to_register(machine, bx, val);
+         } else if(!strcmp(line_contents[1], "cx")) {
+            sub_to_register(machine, cx, val);
+         } else if(!strcmp(line_contents[1], "dx")) {
+            sub_to_register(machine, dx, val);
+         } 
+         else {
+             raise_fault(machine, " [-](sub) invalid instruction argument! (register)");
+             machine->pc++;
+         }
+    } else if(op == OP_MUL) {
+        uint8_t val;
+         if(!strcmp(line_contents[2], "$ax")) {
+            val = get_reg(machine, ax);
+        } else if(!strcmp(line_contents[2], "$bx")) {
+            val = get_reg(machine, bx);
+        } else if(!strcmp(line_contents[2], "$cx")) {
+            val = get_reg(machine, cx);
+        } else if(!strcmp(line_contents[2], "$dx")) {
+            val = get_reg(machine, dx);
+        } else {
+            val = atoi(line_contents[2]);
+        }
+        if(sizeof(val) != sizeof(uint32_t) && sizeof(val) != sizeof(uint8_t)) {
+            raise_fault(machine, " [-](mul) invalid instruction argument! (operand)");
+        }
+         if(!strcmp(line_contents[1], "ax")) {
+            mul_to_register(machine, ax, val);
+         } else if(!strcmp(line_contents[1], "bx")) {
+            mul_to_register(machine, bx, val);
+         } else if(!strcmp(line_contents[1], "cx")) {
+            mul_to_register(machine, cx, val);
+         } else if(!strcmp(line_contents[1], "dx")) {
+            mul_to_register(machine, dx, val);
+         } 
+         else {
+             raise_fault(machine, " [-](mul) invalid instruction argument! (register)");
+             machine->pc++;
+         }
+    } else if(op == OP_DIV) {
+        uint8_t val;
+         if(!strcmp(line_contents[2], "$ax")) {
+            val = get_reg(machine, ax);
+        } else if(!strcmp(line_contents[2], "$bx")) {
+            val = get_reg(machine, bx);
+        } else if(!strcmp(line_contents[2], "$cx")) {
+            val = get_reg(machine, cx);
+        } else if(!strcmp(line_contents[2], "$dx")) {
+            val = get_reg(machine, dx);
+        } else {
+            val = atoi(line_contents[2]);
+        }
+        if(sizeof(val) != sizeof(uint32_t) && sizeof(val) != sizeof(uint8_t)) {
+            raise_fault(machine, " [-](div) invalid instruction argument! (operand)");
+        }
+         if(!strcmp(line_contents[1], "ax")) {
+            div_to_register(machine, ax, val);
+         } else if(!strcmp(line_contents[1], "bx")) {
+            div_to_register(machine, bx, val);
+         } else if(!strcmp(line_contents[1], "cx")) {
+            div_to_register(machine, cx, val);
+         } else if(!strcmp(line_contents[1], "dx")) {
+            div_to_register(machine, dx, val);
+         } 
+         else {
+             raise_fault(machine, " [-](div) invalid instruction argument! (register)");
+             machine->pc++;
+         }
+    } else {
+        is_unknown_instr = true;
+        
+    }
+    
+    if(!is_unknown_instr) {
+        #ifdef _DEBUG_
+        printf("print_registers()\n");
+        #endif
+        if(machine->is_verbose == 1) {
+            print_registers(machine);
+        }
+    } else {
+        // skip it, a fault that doesn't advance pc would repeat forever
+        raise_fault(machine, " [-] unknown instruction!");
+        machine->pc++;
+    }
+
+    return op;
+}
+
+STOP_REASON run_for(machine_t* machine, uint64_t n_instructions) {
+    // paced runs execute PACING_BURST_NS worth of cycles between sleeps
+    uint64_t burst_cycles = (uint64_t)machine->clock_hz * PACING_BURST_NS / 1000000000ull;
+    if(burst_cycles == 0) {
+        burst_cycles = 1;
+    }
+    uint64_t next_sync = machine->cycles + burst_cycles;
+    uint64_t start_cycles = machine->cycles;
+    uint64_t start_ns = get_time_ns();
+
+    STOP_REASON reason = STOP_BUDGET;
+    uint64_t executed = 0;
+    machine->is_stop_requested = 0;
+
+    while(1) {
+        if(machine->halt) {
+            reason = STOP_HALTED;
+            break;
+        }
+        if(executed >= n_instructions) {
+            reason = STOP_BUDGET;
+            break;
+        }
+        // pc is 8 bit and always indexes program memory, an empty slot is the end of the program
+        if(machine->program_memory[machine->pc] == NULL) {
+            raise_fault(machine, " [-] pc points outside of the program!");
+            reason = STOP_FAULT;
+            break;
+        }
+
+        OPCODES op = execute_instruction(machine);
+        ++executed;
+
+        machine->cycles += cycle_costs[op];
+        machine->stats.instructions++;
+        if(machine->clock_hz != 0 && machine->cycles >= next_sync) {
+            pace(machine, start_ns, start_cycles);
+            next_sync = machine->cycles + burst_cycles;
+            if(machine->stats_segment != NULL) {
+                publish_stats(machine);
+            }
+        } else if(machine->stats_segment != NULL && (machine->stats.instructions & (STATS_PUBLISH_INTERVAL-1)) == 0) {
+            publish_stats(machine);
+        }
+
+        if(machine->halt && machine->halt_callback != NULL) {
+            machine->halt_callback(machine, machine->halt_user_data);
+        }
+        if(machine->is_stop_requested) {
+            reason = STOP_FAULT;
+            break;
+        }
+    }
+
+    if(machine->stats_segment != NULL) {
+        publish_stats(machine);
+    }
+
+    if(machine->clock_hz != 0) {
+        // the last partial burst takes its emulated time too, so back to back calls keep the rate
+        pace(machine, start_ns, start_cycles);
+        uint64_t elapsed_ns = get_time_ns() - start_ns;
+        machine->drift_ns = (int64_t)elapsed_ns - (int64_t)cycles_to_ns(machine->cycles - start_cycles, machine->clock_hz);
+    }
+
+    return reason;
+}
+
 uint32_t execute_program(machine_t* machine) {
     // set program counter to start
 
@@ -332,263 +979,36 @@ uint32_t execute_program(machine_t* machine) {
     }
 
     machine->pc = 0;
+    machine->halt = 0;
+    machine->err_counter = 0;
     printf("-------- execute_program() begin --------\n");
-    uint32_t err_counter = 0;
 
     if(machine->is_verbose == 1) {
         uint32_t i = 0;
         printf("PROGRAM MEMORY CONTENT:\n");
     
-        while(machine->program_memory[i] != NULL) {
+        while(i < PROGRAM_MEM_CAPACITY && machine->program_memory[i] != NULL) {
             printf("%s\n", machine->program_memory[i]);
             ++i;
         }
     }
 
-    while(!machine->halt) {
-        char* buf = malloc(50);
-        //printf("%s\n", machine->program_memory[machine->pc]);
-        strcpy(buf, machine->program_memory[machine->pc]);
-        #ifdef _DEBUG_
-        printf("EXECUTE_CODE BUF: %s , machine->pc = %d\n", buf, machine->pc);
-        #endif
-        char* line_contents[MAX_LINE_ELEMENTS];
-
-        uint8_t line_elem_counter = 0;
+    uint64_t start_cycles = machine->cycles;
+    uint64_t start_ns = get_time_ns();
 
-        _Bool is_unknown_instr = false; 
-        
-        // tokenize line
-        char* tok = strtok(buf, delim);
-        while(tok != NULL) {
-            line_contents[line_elem_counter++] = tok;
-            tok = strtok(NULL, delim);
-        }
-
-        // interpret tokenized form, assume there is no line with more than 50 words
-        if(strcmp(line_contents[0], "mov") == 0) {
-            uint8_t val;
-             if(!strcmp(line_contents[2], "$ax")) {
-                val = get_reg(machine, ax);
-            } else if(!strcmp(line_contents[2], "$bx")) {
-                val = get_reg(machine, bx);
-            } else if(!strcmp(line_contents[2], "$cx")) {
-                val = get_reg(machine, cx);
-            } else if(!strcmp(line_contents[2], "$dx")) {
-                val = get_reg(machine, dx);
-            } else {
-                val = atoi(line_contents[2]);
-            }
-            if(sizeof(val) != sizeof(uint32_t) && sizeof(val) != sizeof(uint8_t)) {
-                fprintf(stderr, " [-](mov) invalid instruction argument! (operand)\n");
-                ++err_counter;
-            }
-            // mov instr -> check for arguments
-            if(strcmp(line_contents[1], "ax") == 0) {
-                store_to_reg(machine, ax, val);
-            } else if(strcmp(line_contents[1], "bx") == 0) {
-                store_to_reg(machine, bx, val);
-            } else if(strcmp(line_contents[1], "cx") == 0) {
-                store_to_reg(machine, cx, val);
-            } else if(strcmp(line_contents[1], "dx") == 0) {
-                store_to_reg(machine, dx, val);
-
-            } else if(line_contents[1][0] == '%') {
-                // memory locations marked with %
-                uint32_t memory_addr = atoi(line_contents[1] + 1);
-                poke(machine, memory_addr, val);
-            
-            } else {
-                fprintf(stderr, " [-] - invalid `mov` instruction arguments!\n");
-                ++err_counter;
-            }
+    run_for(machine, UINT64_MAX);
 
-        } else if(strcmp(line_contents[0], "cmp") == 0) {
-            compare(machine, line_contents[1], line_contents[2]);
-        } else if(strcmp(line_contents[0], "jmp") == 0) {
-            jump(machine, atoi(line_contents[1]));
-        } else if(strcmp(line_contents[0], "jz") == 0) {
-            jump_if_not_zero(machine, atoi(line_contents[1]));
-        } else if(strcmp(line_contents[0], "pop") == 0) {
-            // first argument is the specified register
-            if(strcmp(line_contents[1], "ax") == 0) {
-                pop_stack(machine, ax);
-            } else if(strcmp(line_contents[1], "bx") == 0) {
-                pop_stack(machine, bx);
-            } else if(strcmp(line_contents[1], "cx") == 0) {
-                pop_stack(machine, cx);
-            } else if(strcmp(line_contents[1], "dx") == 0) {
-                pop_stack(machine, dx);
-            }
-        } else if(strcmp(line_contents[0], "push") == 0) {
-            if(strcmp(line_contents[1], "ax") == 0) {
-                push_stack(machine, ax);
-            } else if(strcmp(line_contents[1], "bx") == 0) {
-                push_stack(machine, bx);
-            } else if(strcmp(line_contents[1], "cx") == 0) {
-                push_stack(machine, cx);
-            } else if(strcmp(line_contents[1], "dx") == 0) {
-                push_stack(machine, dx);
-            }
-        } else if(strcmp(line_contents[0], "lea") == 0) {
-            // TODO: implement
-        } else if(strcmp(line_contents[0], "nop") == 0) {
-            // NOTHING - most useful instruction ever
-            // has to be included because of nop slides
-            no_op(machine);
-        } else if(strcmp(line_contents[0], "hlt") == 0) {
-            halt(machine);
-        } else if(strcmp(line_contents[0], "end") == 0) {
-            halt(machine);
-            
-        } else if(strcmp(line_contents[0], "add") == 0) {
-            uint8_t val;
-                 // get val from get_reg
-            if(!strcmp(line_contents[2], "$ax")) {
-                val = get_reg(machine, ax);
-            } else if(!strcmp(line_contents[2], "$bx")) {
-                val = get_reg(machine, bx);
-            } else if(!strcmp(line_contents[2], "$cx")) {
-                val = get_reg(machine, cx);
-            } else if(!strcmp(line_contents[2], "$dx")) {
-                val = get_reg(machine, dx);
-            } else {
-                val = atoi(line_contents[2]);
-            }
-             
-             if(sizeof(val) != sizeof(uint32_t) && sizeof(val) != sizeof(uint8_t)) {
-                fprintf(stderr, " [-](add) invalid instruction argument! (operand)\n");
-                ++err_counter;
-            }
-             if(!strcmp(line_contents[1], "ax")) {
-                add_to_register(machine, ax, val);
-             } else if(!strcmp(line_contents[1], "bx")) {
-                add_to_register(machine, bx, val);
-             } else if(!strcmp(line_contents[1], "cx")) {
-                add_to_register(machine, cx, val);
-             } else if(!strcmp(line_contents[1], "dx")) {
-                add_to_register(machine, dx, val);
-             } 
-             else {
-                 fprintf(stderr, " [-](add) invalid instruction argument! (register)\n");
-                 ++err_counter;
-             }
-        } else if(strcmp(line_contents[0], "sub") == 0) {
-            uint8_t val;
-             if(!strcmp(line_contents[2], "$ax")) {
-                val = get_reg(machine, ax);
-            } else if(!strcmp(line_contents[2], "$bx")) {
-                val = get_reg(machine, bx);
-            } else if(!strcmp(line_contents[2], "$cx")) {
-                val = get_reg(machine, cx);
-            } else if(!strcmp(line_contents[2], "$dx")) {
-                val = get_reg(machine, dx);
-            } else {
-                val = atoi(line_contents[2]);
-            }
-            if(sizeof(val) != sizeof(uint32_t) && sizeof(val) != sizeof(uint8_t)) {
-                fprintf(stderr, " [-](sub) invalid instruction argument! (operand)\n");
-                ++err_counter;
-            }
-             if(!strcmp(line_contents[1], "ax")) {
-                sub_to_register(machine, ax, val);
-             } else if(!strcmp(line_contents[1], "bx")) {
-                sub_to_register(machine, bx, val);
-             } else if(!strcmp(line_contents[1], "cx")) {
-                sub_to_register(machine, cx, val);
-             } else if(!strcmp(line_contents[1], "dx")) {
-                sub_to_register(machine, dx, val);
-             } 
-             else {
-                 fprintf(stderr, " [-](sub) invalid instruction argument! (register)\n");
-                 ++err_counter;
-             }
-        } else if(strcmp(line_contents[0], "mul") == 0) {
-            uint8_t val;
-             if(!strcmp(line_contents[2], "$ax")) {
-                val = get_reg(machine, ax);
-            } else if(!strcmp(line_contents[2], "$bx")) {
-                val = get_reg(machine, bx);
-            } else if(!strcmp(line_contents[2], "$cx")) {
-                val = get_reg(machine, cx);
-            } else if(!strcmp(line_contents[2], "$dx")) {
-                val = get_reg(machine, dx);
-            } else {
-                val = atoi(line_contents[2]);
-            }
-            if(sizeof(val) != sizeof(uint32_t) && sizeof(val) != sizeof(uint8_t)) {
-                fprintf(stderr, " [-](mul) invalid instruction argument! (operand)\n");
-                ++err_counter;
-            }
-             if(!strcmp(line_contents[1], "ax")) {
-                mul_to_register(machine, ax, val);
-             } else if(!strcmp(line_contents[1], "bx")) {
-                mul_to_register(machine, bx, val);
-             } else if(!strcmp(line_contents[1], "cx")) {
-                mul_to_register(machine, cx, val);
-             } else if(!strcmp(line_contents[1], "dx")) {
-                mul_to_register(machine, dx, val);
-             } 
-             else {
-                 fprintf(stderr, " [-](mul) invalid instruction argument! (register)\n");
-                 ++err_counter;
-             }
-        } else if(strcmp(line_contents[0], "div") == 0) {
-            uint8_t val;
-             if(!strcmp(line_contents[2], "$ax")) {
-                val = get_reg(machine, ax);
-            } else if(!strcmp(line_contents[2], "$bx")) {
-                val = get_reg(machine, bx);
-            } else if(!strcmp(line_contents[2], "$cx")) {
-                val = get_reg(machine, cx);
-            } else if(!strcmp(line_contents[2], "$dx")) {
-                val = get_reg(machine, dx);
-            } else {
-                val = atoi(line_contents[2]);
-            }
-            if(sizeof(val) != sizeof(uint32_t) && sizeof(val) != sizeof(uint8_t)) {
-                fprintf(stderr, " [-](div) invalid instruction argument! (operand)\n");
-                ++err_counter;
-            }
-             if(strcmp(line_contents[1], "ax")) {
-                div_to_register(machine, ax, val);
-             } else if(!strcmp(line_contents[1], "bx")) {
-                div_to_register(machine, bx, val);
-             } else if(!strcmp(line_contents[1], "cx")) {
-                div_to_register(machine, cx, val);
-             } else if(!strcmp(line_contents[1], "dx")) {
-                div_to_register(machine, dx, val);
-             } 
-             else {
-                 fprintf(stderr, " [-](div) invalid instruction argument! (register)\n");
-                 ++err_counter;
-             }
-        } else {
-            is_unknown_instr = true;
-            
-        }
-        
-        if(!is_unknown_instr) {
-            #ifdef _DEBUG_
-            printf("print_registers()\n");
-            #endif
-            if(machine->is_verbose == 1) {
-                print_registers(machine);
-            }
-        } else {
-            fprintf(stderr, " [-] unknown instruction!\n");
-            ++err_counter;
-        }
-        
-        is_unknown_instr = false;
-        
-        free(buf);
-    
+    if(machine->clock_hz != 0) {
+        uint64_t run_cycles = machine->cycles - start_cycles;
+        uint64_t elapsed_ns = get_time_ns() - start_ns;
+        printf("PACING: %u Hz target, %llu cycles in %.3f ms (%.0f Hz), drift %+.3f ms\n",
+            machine->clock_hz, (unsigned long long)run_cycles, elapsed_ns / 1e6,
+            elapsed_ns != 0 ? run_cycles * 1e9 / elapsed_ns : 0.0, machine->drift_ns / 1e6);
     }
 
     printf("-------- execute() end --------\n");
 
-    return err_counter;
+    return machine->err_counter;
 }
 
 void set_redirect_machine_output(machine_t* machine, int flag) {
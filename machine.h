@@ -15,14 +15,40 @@
     Special flags:
         halt: halt signal
 
+    Statistics:
+        instructions, branches, memory reads/writes and the stack high-water mark are
+        counted in machine->stats and published to a shared memory segment if one is
+        attached (see stats.h)
+
+    Library:
+        create_machine()/destroy_machine() own a machine, load_program() (linker.h) assembles
+        a source held in memory, run_for() executes up to n instructions and returns why it
+        stopped. Errors are kept per machine in err_counter and reported through the fault
+        callback (or stderr without one), halts through the halt callback.
+
+    Clock:
+        every instruction costs cycle_costs[opcode] cycles. With a clock frequency set,
+        execute_program() runs in bursts of PACING_BURST_NS emulated time and sleeps until
+        the host clock catches up, instead of running as fast as possible.
+
     Memory:
         General purpose (Functions as Heap):
             size: 1024*64
             functions:
                 peak - Get data at specific address - only address bound check, NO DATA CHECK!
                 poke - Store data at specific address - only address. bound check, NO DATA CHECK!
+                fill_memory, copy_memory, compare_memory - block operations on a whole address
+                    range, the range is bound checked as a whole before any byte is touched
+            addressing:
+                %N - literal address
+                [hi:lo] - address hi*256+lo held in a pair of general purpose registers,
+                    `mov reg [hi:lo]` loads through peek(), `mov [hi:lo] value` stores through poke()
+                [hi:lo+] - same, then the pair is incremented as one 16 bit value, past the
+                    last byte it wraps around to address 0 without a fault
+                lea hi:lo %N - load the address N into a register pair
         Stack:
-            size: 1024
+            size: 1024, sp counts the values on it and is 8 bit, so at most STACK_DEPTH
+            are used; push past it and pop from an empty stack raise a fault
 
 */
 
@@ -36,6 +62,8 @@
 #include <stdlib.h>
 #include <time.h>
 
+#include "stats.h"
+
 // define ansi colors if compiled with unix system
 #ifdef __unix__
 #define BLK "\e[0;30m"
@@ -48,15 +76,35 @@
 #define WHT "\e[0;37m"
 #endif
 
-const char delim[2] = " ";
+// the shared library is built with hidden visibility, only the embedding API is exported
+#if defined(__GNUC__) && !defined(_WIN32)
+#define KYEMU_API __attribute__((visibility("default")))
+#else
+#define KYEMU_API
+#endif
 
 #define GEN_MEM_CAPACITY 1024*64
 #define PROGRAM_MEM_CAPACITY 1024
+// pc is an 8 bit register, lines past this can never be reached
+#define MAX_PROGRAM_LINES (UINT8_MAX + 1)
 #define STACK_CAPACITY 1024
+#define STACK_DEPTH (STACK_CAPACITY < UINT8_MAX ? STACK_CAPACITY : UINT8_MAX)
 #define RES_X 24
 #define RES_Y 24
 // assume there's a maximum of 50 space-delimetered "words" in a line
 #define MAX_LINE_ELEMENTS 50
+#define MAX_LINE_LEN 1024
+
+typedef enum STOP_REASON {
+    STOP_HALTED,    // hlt/end executed
+    STOP_BUDGET,    // the requested number of instructions ran
+    STOP_FAULT      // pc left the program, or the fault callback asked to stop
+} STOP_REASON;
+
+struct machine;
+typedef void (*halt_callback_t)(struct machine* machine, void* user_data);
+// return non-zero to stop run_for() after the faulting instruction
+typedef int (*fault_callback_t)(struct machine* machine, uint32_t pc, const char* message, void* user_data);
 
 typedef struct machine {
     uint8_t halt;
@@ -64,7 +112,7 @@ typedef struct machine {
 
     int is_output_redirected;
 
-    struct mem {
+    struct {
         uint8_t general_memory[GEN_MEM_CAPACITY];
         uint8_t stack[STACK_CAPACITY];
     };
@@ -74,23 +122,84 @@ typedef struct machine {
 
     int is_verbose;
 
+    // errors of the current run, see raise_fault()
+    uint32_t err_counter;
+    int is_stop_requested;
+    halt_callback_t halt_callback;
+    void* halt_user_data;
+    fault_callback_t fault_callback;
+    void* fault_user_data;
+
+    // emulated clock in Hz, 0 runs as fast as possible
+    uint32_t clock_hz;
+    uint64_t cycles;
+    // how far behind (+) or ahead (-) of the emulated clock the last paced run finished
+    int64_t drift_ns;
+
+    machine_stats_t stats;
+    // shared memory export of `stats`, NULL if disabled
+    stats_segment_t* stats_segment;
+    // start of the current instructions_per_sec window
+    uint64_t stats_publish_ns;
+    uint64_t stats_publish_instructions;
+
 } machine_t;
 
 typedef enum REGS {
     ax, bx, cx, dx, sp, bp, pc, fl
 } REGS;
 
+typedef enum OPCODES {
+    OP_MOV, OP_CMP, OP_JMP, OP_JZ, OP_POP, OP_PUSH, OP_LEA, OP_NOP, OP_HLT, OP_END,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_FILL, OP_COPY, OP_MCMP, OP_UNKNOWN, OP_COUNT
+} OPCODES;
+
+// cycles taken by each instruction, roughly modelled on 8080 timings
+extern const uint8_t cycle_costs[OP_COUNT];
+
+// block memory instructions cost this much per byte on top of their cycle_costs entry
+#define BLOCK_CYCLES_PER_BYTE 2
+
+// paced execution sleeps after every burst of this much emulated time
+#define PACING_BURST_NS 1000000
+
+KYEMU_API machine_t* create_machine(void);
+KYEMU_API void destroy_machine(machine_t* machine);
+KYEMU_API void set_halt_callback(machine_t* machine, halt_callback_t callback, void* user_data);
+KYEMU_API void set_fault_callback(machine_t* machine, fault_callback_t callback, void* user_data);
+KYEMU_API STOP_REASON run_for(machine_t* machine, uint64_t n_instructions);
+void raise_fault(machine_t* machine, const char* message);
+void clear_program_memory(machine_t* machine);
+KYEMU_API void set_reg(machine_t* machine, enum REGS reg, uint8_t value);
+KYEMU_API uint32_t read_memory(const machine_t* machine, uint32_t addr, uint8_t* dst, uint32_t len);
+KYEMU_API uint32_t write_memory(machine_t* machine, uint32_t addr, const uint8_t* src, uint32_t len);
+uint32_t split_line(char* line, char** tokens, uint32_t max_tokens);
+uint32_t get_core_count(void);
+uint64_t get_time_ns(void);
 void set_verbosity(machine_t* machine, int verbosity);
+void set_clock_frequency(machine_t* machine, uint32_t hz);
+OPCODES get_opcode(const char* name);
 uint32_t execute_program(machine_t* machine);
-void add_to_program_memory(machine_t* machine, char* line);
+void add_to_program_memory(machine_t* machine, const char* line);
 void reset(machine_t* machine);
 void store_to_reg(machine_t* machine, enum REGS reg, uint8_t value);
-uint8_t get_reg(machine_t* machine, enum REGS reg);
+KYEMU_API uint8_t get_reg(machine_t* machine, enum REGS reg);
 void poke(machine_t* machine, uint32_t addr, uint8_t value);
 uint8_t peek(const machine_t* machine, uint32_t addr);
 void poke_stack(machine_t* machine, uint32_t addr, uint8_t value);
 uint8_t peek_stack(const machine_t* machine, uint32_t addr);
 void compare(machine_t* machine, char* reg_1, char* reg_2);
+void compare_regs(machine_t* machine, int reg_1, int reg_2);
+int parse_reg(const char* name);
+uint32_t parse_reg_pair(const char* text, int* hi, int* lo);
+uint32_t parse_indirect(const char* text, int* hi, int* lo, int* is_increment);
+uint32_t get_pair_address(machine_t* machine, enum REGS hi, enum REGS lo);
+void load_address(machine_t* machine, enum REGS hi, enum REGS lo, uint32_t addr);
+void load_indirect(machine_t* machine, enum REGS reg, enum REGS hi, enum REGS lo, int is_increment);
+void store_indirect(machine_t* machine, enum REGS hi, enum REGS lo, uint8_t value, int is_increment);
+uint32_t fill_memory(machine_t* machine, uint32_t addr, uint32_t len, uint8_t value);
+uint32_t copy_memory(machine_t* machine, uint32_t dst, uint32_t src, uint32_t len);
+uint32_t compare_memory(machine_t* machine, uint32_t addr_1, uint32_t addr_2, uint32_t len);
 uint32_t stack_bottom(machine_t* machine);
 void pop_stack(machine_t* machine, enum REGS reg);
 void push_stack(machine_t* machine, enum REGS reg);
@@ -9,91 +9,113 @@
 #include <stdio.h>
 #include <string.h>
 #include <memory.h>
-#include "machine.c"
+#include "machine.h"
+#include "linker.h"
+#include "decode.h"
+#include "sweep.h"
 #include <stdlib.h>
 #include <stdbool.h>
-#include <io.h>
-#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#ifdef __unix__
+#include <unistd.h>
+#endif
 
-// assume one line doesn't contain more than 8 bits worth of chars
-#define BUF_LEN (2<<9)-1
-#define MAX_LINE_ELEMENTS 50
 /*
     Supported instructions: (...) -> to be implemented
-    mov, cmp, jmp, jz, pop, push, (lea), nop, hlt, (ret), add, sub, mul, div
+    mov, cmp, jmp, jz, pop, push, lea, nop, hlt, (ret), add, sub, mul, div,
+    fill, copy, mcmp
     
 */
 
-uint32_t g_err_counter = 0;
-
-void read_code(machine_t* machine, const char* source_file_name) {
-
-    // create relative path to source file
-    char source_path[] = "./source/";
-    strcat(source_path, source_file_name);
+uint32_t read_code(machine_t* machine, const char* source_dir, char** source_file_names, uint32_t n) {
 
     reset(machine);
     #ifdef _DEBUG_
     printf("1 read_code()\n");
     #endif
-    FILE* fp = fopen(source_path, "r");
-    if(fp == NULL) {
-        fprintf(stderr, "[-] fopen() - Cannot open source file!\n");
-        ++g_err_counter;
-        return;
+
+    // assemble (or reuse) every module under source_dir and link them into program memory
+    uint32_t err_counter = build_program(machine, source_dir, source_file_names, n);
+    if(err_counter != 0) {
+        fprintf(stderr, "[-] read_code() - Cannot build program!\n");
+        return err_counter;
     }
-    
-    char buf[BUF_LEN];
+
     #ifdef _DEBUG_
-    uint32_t ln = 0;
+    printf("2 read_code()\n");
     #endif
-    while(fgets(buf, BUF_LEN, fp)) {
-        // only look at non-empty lines
-        //remove trailing newline
-        buf[strcspn(buf, "\n")] = 0;
-        if(strcmp(buf, "\n") != 0) {
-
-        #ifdef _DEBUG_
-        printf("BUF: %s\n", buf);
-        #endif
-        char* line_contents[MAX_LINE_ELEMENTS];
-        uint8_t line_elem_counter = 0;
 
-        char buf2[BUF_LEN];
-        strcpy(buf2, buf);
+    return execute_program(machine);
 
-        char* tok = strtok(buf2, delim);
-        while(tok != NULL) {
-            line_contents[line_elem_counter++] = tok;
-            tok = strtok(NULL, delim);
-        }
+}
 
-        if(strlen(buf) != 0 && strcmp(line_contents[0], ";") != 0) {
-            #ifdef _DEBUG_
-            fprintf(stdout, "LINE #%d: %s\n", ++ln, buf);
-            #endif
-            add_to_program_memory(machine, buf);
-        }
-        }
+uint32_t sweep_code(machine_t* machine, const char* source_dir, char** source_file_names, uint32_t n, sweep_t* sweep, const char* inputs_path, const char* results_path) {
+
+    reset(machine);
+
+    uint32_t err_counter = build_program(machine, source_dir, source_file_names, n);
+    if(err_counter != 0) {
+        fprintf(stderr, "[-] sweep_code() - Cannot build program!\n");
+        return err_counter;
     }
 
-    fclose(fp);
-    fp = NULL;
-    
-    #ifdef _DEBUG_
-    printf("2 read_code()\n");
-    #endif
+    // decode once, every worker shares the same program
+    program_t program;
+    if(decode_program(&program, machine) != 0) {
+        return 1;
+    }
+    sweep_inputs_t inputs;
+    if(load_sweep_inputs(&inputs, inputs_path) != 0) {
+        free_program(&program);
+        return 1;
+    }
+
+    sweep->program = &program;
+    sweep->inputs = &inputs;
+    err_counter = run_sweep(sweep, results_path);
+
+    free_sweep_inputs(&inputs);
+    free_program(&program);
+    return err_counter;
+
+}
 
-    g_err_counter = execute_program(machine);
+// statistics segment of the running machine, closed by the handler if a signal ends the process
+static stats_segment_t* _Atomic signal_segment = NULL;
 
+static void close_segment_on_signal(int sig) {
+    close_stats_segment(atomic_exchange(&signal_segment, NULL));
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void destroy_main_machine(machine_t* machine) {
+    // from here on destroy_machine() owns the segment
+    atomic_store(&signal_segment, NULL);
+    destroy_machine(machine);
 }
 
 int main(int argc, char** argv) {
 
-    machine_t* machine = (machine_t*) malloc(sizeof(machine_t));
+    machine_t* machine = create_machine();
+    if(machine == NULL) {
+        return -1;
+    }
 
-    // default source file name
-    char source_file_name[] = "source.kyasm";
+    // default source directory and file name
+    char source_dir[MAX_PATH_LEN] = "./source/";
+    char default_source_file_name[] = "source.kyasm";
+    char* source_file_names[MAX_MODULES];
+    uint32_t source_file_count = 0;
+    int is_stats_enabled = 0;
+    int is_pause_enabled = 0;
+    // parameter sweep, only if an input table is given
+    char* sweep_inputs_path = NULL;
+    char* sweep_results_path = "sweep_results.csv";
+    sweep_t sweep;
+    memset(&sweep, 0, sizeof(sweep));
+    sweep.max_instructions = 1000000;
     // set verbosity to 0 by default
     set_verbosity(machine, 0);
     
@@ -101,7 +123,8 @@ int main(int argc, char** argv) {
         
         if(strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "-help") == 0) {
             // help
-            fprintf(stdout, "Usage: main.exe [-S <filename>] [-V]\n\t-V: verbose output\n\t-S <filename>: specify assembly source file\n");
+            fprintf(stdout, "Usage: main.exe [-D <dir>] [-S <filename>]... [-V] [-C <hz>] [-M] [-P] [-W <table> [-R <file>] [-X %%<addr>:<len>]... [-N <n>] [-T <n>] [-E <engine>]]\n\t-V: verbose output\n\t-D <dir>: directory of the source files (default ./source/)\n\t-P: wait for a key before exiting\n\t-W <table>: run a parameter sweep over the rows of a CSV/binary input table\n\t-R <file>: sweep results file (default sweep_results.csv)\n\t-X %%<addr>:<len>: memory range to collect in the sweep results, repeatable\n\t-N <n>: instruction budget of every sweep run (default 1000000)\n\t-T <n>: sweep worker threads (default: one per core)\n\t-E <decoded|simd>: sweep execution engine (default decoded)\n\t-M: publish live statistics for the stat tool (kystat <pid>)\n\t-C <hz>: run at a fixed emulated clock frequency\n\t-S <filename>: specify assembly source file, repeat to link several modules\n");
+            destroy_machine(machine);
             return 0;
         }
 
@@ -111,14 +134,94 @@ int main(int argc, char** argv) {
             if(strcmp(argv[i], "-V") == 0) {
                 set_verbosity(machine, 1);
             }
+            if(strcmp(argv[i], "-D") == 0) {
+                // read source files from another directory
+                if(i+1 >= argc || strlen(argv[i+1]) == 0 || strlen(argv[i+1]) + 2 > MAX_PATH_LEN) {
+                    fprintf(stderr, "[-] - invalid source directory!\n");
+                    destroy_machine(machine);
+                    return -1;
+                }
+                strcpy(source_dir, argv[++i]);
+                char last = source_dir[strlen(source_dir)-1];
+                if(last != '/' && last != '\\') {
+                    strcat(source_dir, "/");
+                }
+            }
             if(strcmp(argv[i], "-S") == 0) {
             // use custom source file for assembly code
-                if(argv[i+1] != NULL && strlen(argv[i+1]) == 0) {
+                if(i+1 >= argc || strlen(argv[i+1]) == 0) {
                     fprintf(stderr, "[-] - source file name cannot be empty!\n");
+                    destroy_machine(machine);
                     return -1;
+                } else if(source_file_count >= MAX_MODULES) {
+                    fprintf(stderr, "[-] - too many source files!\n");
+                    destroy_machine(machine);
+                    return -1;
+                } else {
+                    source_file_names[source_file_count++] = argv[++i];
+                }
+            }
+            if(strcmp(argv[i], "-C") == 0) {
+                // pace execution to an emulated clock
+                if(i+1 >= argc || atoi(argv[i+1]) <= 0) {
+                    fprintf(stderr, "[-] - clock frequency must be a positive number of Hz!\n");
+                    destroy_machine(machine);
+                    return -1;
+                }
+                set_clock_frequency(machine, atoi(argv[++i]));
+            }
+            if(strcmp(argv[i], "-M") == 0) {
+                // export live statistics through shared memory
+                is_stats_enabled = 1;
+            }
+            if(strcmp(argv[i], "-W") == 0 || strcmp(argv[i], "-R") == 0) {
+                if(i+1 >= argc || strlen(argv[i+1]) == 0) {
+                    fprintf(stderr, "[-] - %s needs a file name!\n", argv[i]);
+                    destroy_machine(machine);
+                    return -1;
+                }
+                if(strcmp(argv[i], "-W") == 0) {
+                    sweep_inputs_path = argv[++i];
                 } else {
-                    strcpy(source_file_name, argv[2]);
+                    sweep_results_path = argv[++i];
+                }
+            }
+            if(strcmp(argv[i], "-X") == 0) {
+                if(i+1 >= argc || sweep.range_count >= MAX_SWEEP_RANGES || parse_sweep_range(&sweep.ranges[sweep.range_count], argv[i+1]) != 0) {
+                    fprintf(stderr, "[-] - invalid sweep memory range!\n");
+                    destroy_machine(machine);
+                    return -1;
                 }
+                ++sweep.range_count;
+                ++i;
+            }
+            if(strcmp(argv[i], "-N") == 0 || strcmp(argv[i], "-T") == 0) {
+                if(i+1 >= argc || atoll(argv[i+1]) <= 0) {
+                    fprintf(stderr, "[-] - %s must be a positive number!\n", argv[i]);
+                    destroy_machine(machine);
+                    return -1;
+                }
+                if(strcmp(argv[i], "-N") == 0) {
+                    sweep.max_instructions = atoll(argv[++i]);
+                } else {
+                    sweep.n_threads = atoi(argv[++i]);
+                }
+            }
+            if(strcmp(argv[i], "-E") == 0) {
+                // sweep engine, simd runs lanes of machines in lockstep
+                if(i+1 < argc && strcmp(argv[i+1], "decoded") == 0) {
+                    sweep.engine = SWEEP_ENGINE_DECODED;
+                } else if(i+1 < argc && strcmp(argv[i+1], "simd") == 0) {
+                    sweep.engine = SWEEP_ENGINE_SIMD;
+                } else {
+                    fprintf(stderr, "[-] - unknown sweep engine!\n");
+                    destroy_machine(machine);
+                    return -1;
+                }
+                ++i;
+            }
+            if(strcmp(argv[i], "-P") == 0) {
+                is_pause_enabled = 1;
             }
             if(strcmp(argv[i], "-O") == 0) {
                set_redirect_machine_output(machine, 1);
@@ -132,12 +235,35 @@ int main(int argc, char** argv) {
     printf("1 main()\n");
     #endif
 
-    read_code(machine, source_file_name);
+    if(source_file_count == 0) {
+        source_file_names[source_file_count++] = default_source_file_name;
+    }
+
+    if(is_stats_enabled) {
+        char stats_name[STATS_NAME_LEN];
+        #ifdef __unix__
+        get_stats_segment_name(stats_name, (long)getpid());
+        #else
+        get_stats_segment_name(stats_name, 0);
+        #endif
+        machine->stats_segment = open_stats_segment(stats_name);
+        // an endless program is stopped with a signal, which would leave the segment behind
+        atomic_store(&signal_segment, machine->stats_segment);
+        signal(SIGINT, close_segment_on_signal);
+        signal(SIGTERM, close_segment_on_signal);
+    }
+
+    uint32_t err_counter;
+    if(sweep_inputs_path != NULL) {
+        err_counter = sweep_code(machine, source_dir, source_file_names, source_file_count, &sweep, sweep_inputs_path, sweep_results_path);
+    } else {
+        err_counter = read_code(machine, source_dir, source_file_names, source_file_count);
+    }
     
-    if(g_err_counter != 0) {
+    if(err_counter != 0) {
         fprintf(stderr, "[===> CODE EXECUTION <===] - ERROR(S)!\n");
-        fprintf(stderr, "Errors: %d\n", g_err_counter);
-        free(machine);
+        fprintf(stderr, "Errors: %d\n", err_counter);
+        destroy_main_machine(machine);
         return -1;
     } else {
         fprintf(stderr, "[===> CODE EXECUTION <===] - SUCCESS!\n");
@@ -149,9 +275,11 @@ int main(int argc, char** argv) {
     printf("2 main()\n");
     #endif
 
-    free(machine);
+    destroy_main_machine(machine);
 
-    fprintf(stdout, "enter any key to continue...\n");
-    fgetc(stdin);
+    if(is_pause_enabled) {
+        fprintf(stdout, "enter any key to continue...\n");
+        fgetc(stdin);
+    }
     return 0;
 }
\ No newline at end of file
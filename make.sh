@@ -1,5 +1,5 @@
 function clear() {
-    rm ./*.exe
+    rm -f ./*.exe ./*.o ./*.a ./*.so ./*.dll ./main ./kystat ./kyfuzz
 }
 
 function advice() {
@@ -15,4 +15,22 @@ elif [ "$1" = "help" ]; then
     exit
 fi
 
-gcc main.c -Wall -o main
\ No newline at end of file
+CFLAGS="-Wall -O3"
+LIBS="-lpthread"
+SHARED_LIB="kyemu.dll"
+# shm_open() lives in librt on linux
+if [ "$(uname)" = "Linux" ]; then
+    LIBS="$LIBS -lrt"
+    SHARED_LIB="libkyemu.so"
+fi
+
+# emulator library, static and shared
+# hidden visibility keeps the internal helpers (reset, halt, jump, ...) out of the shared
+# library's symbol table, only the KYEMU_API functions are exported
+gcc $CFLAGS -fPIC -fvisibility=hidden -c machine.c linker.c stats.c decode.c sweep.c simd.c || exit 1
+ar rcs libkyemu.a machine.o linker.o stats.o decode.o sweep.o simd.o
+gcc -shared -o $SHARED_LIB machine.o linker.o stats.o decode.o sweep.o simd.o $LIBS
+
+gcc $CFLAGS main.c -o main libkyemu.a $LIBS
+gcc $CFLAGS stat.c -o kystat libkyemu.a $LIBS
+gcc $CFLAGS fuzz.c -o kyfuzz libkyemu.a $LIBS
@@ -0,0 +1,338 @@
+#include "simd.h"
+
+#include <string.h>
+
+// write the lane's registers and the group counters back to its machine
+static void store_lane(simd_group_t* group, uint32_t lane) {
+    machine_t* machine = group->machines[lane];
+    machine->ax = group->regs[ax][lane];
+    machine->bx = group->regs[bx][lane];
+    machine->cx = group->regs[cx][lane];
+    machine->dx = group->regs[dx][lane];
+    machine->fl = group->fl[lane];
+    machine->pc = group->pc;
+
+    machine->cycles += group->cycles;
+    machine->stats.instructions += group->executed;
+    machine->stats.branches += group->branches;
+    machine->stats.memory_reads += group->memory_reads;
+    machine->stats.memory_writes += group->memory_writes;
+}
+
+// take a lane out of the group, it continues from the current instruction on its own
+static void peel_lane(simd_group_t* group, uint32_t lane, const program_t* program, uint64_t n_instructions, STOP_REASON* reasons) {
+    store_lane(group, lane);
+    group->is_active[lane] = 0;
+    group->active_count--;
+    reasons[lane] = run_decoded(group->machines[lane], program, n_instructions - group->executed);
+}
+
+static void get_values(const simd_group_t* group, const operand_t* operand, uint8_t* values) {
+    if(operand->kind == OPERAND_REG) {
+        memcpy(values, group->regs[operand->reg], SIMD_LANES);
+    } else {
+        memset(values, (uint8_t)operand->value, SIMD_LANES);
+    }
+}
+
+// full width value of an operand in one lane, block lengths aren't truncated to 8 bits
+static uint32_t get_lane_value(const simd_group_t* group, const operand_t* operand, uint32_t lane) {
+    return operand->kind == OPERAND_REG ? group->regs[operand->reg][lane] : operand->value;
+}
+
+static int is_valid_range(uint32_t addr, uint32_t len) {
+    return addr < GEN_MEM_CAPACITY && len <= GEN_MEM_CAPACITY - addr;
+}
+
+// addresses held in a register pair, they always fall inside of memory
+static void get_pair_addresses(const simd_group_t* group, const operand_t* pair, uint32_t* addrs) {
+    const uint8_t* hi = group->regs[pair->reg];
+    const uint8_t* lo = group->regs[pair->reg_lo];
+    for(uint32_t l = 0; l < SIMD_LANES; ++l) {
+        addrs[l] = (uint32_t)hi[l] << 8 | lo[l];
+    }
+}
+
+static void increment_pairs(simd_group_t* group, const operand_t* pair) {
+    uint8_t* hi = group->regs[pair->reg];
+    uint8_t* lo = group->regs[pair->reg_lo];
+    for(uint32_t l = 0; l < SIMD_LANES; ++l) {
+        lo[l]++;
+        hi[l] += lo[l] == 0;
+    }
+}
+
+// returns 0 if the instruction has no lockstep form, the group then falls back to run_decoded()
+static int execute_lockstep(simd_group_t* group, const instruction_t* instruction, const program_t* program, uint64_t n_instructions, STOP_REASON* reasons) {
+    const operand_t* dst = &instruction->dst;
+    uint8_t values[SIMD_LANES];
+
+    // inactive lanes are computed too, their registers are never read back
+    switch(instruction->op) {
+        case OP_MOV: {
+            if(instruction->is_invalid) {
+                return 0;
+            }
+            // register-pair indirect, memory is per lane so only the addressing is vectorized
+            if(instruction->src.kind == OPERAND_PAIR || dst->kind == OPERAND_PAIR) {
+                const operand_t* pair = dst->kind == OPERAND_PAIR ? dst : &instruction->src;
+                uint32_t addrs[SIMD_LANES];
+                get_pair_addresses(group, pair, addrs);
+                if(dst->kind == OPERAND_PAIR) {
+                    get_values(group, &instruction->src, values);
+                    for(uint32_t l = 0; l < group->lane_count; ++l) {
+                        if(group->is_active[l]) {
+                            group->machines[l]->general_memory[addrs[l]] = values[l];
+                        }
+                    }
+                    group->memory_writes++;
+                } else {
+                    memset(values, 0, SIMD_LANES);
+                    for(uint32_t l = 0; l < group->lane_count; ++l) {
+                        if(group->is_active[l]) {
+                            values[l] = group->machines[l]->general_memory[addrs[l]];
+                        }
+                    }
+                    group->memory_reads++;
+                }
+                if(pair->is_increment) {
+                    increment_pairs(group, pair);
+                }
+                // a load writes its register after the increment, like load_indirect()
+                if(dst->kind == OPERAND_REG) {
+                    memcpy(group->regs[dst->reg], values, SIMD_LANES);
+                }
+                group->pc++;
+                return 1;
+            }
+            get_values(group, &instruction->src, values);
+            if(dst->kind == OPERAND_REG) {
+                memcpy(group->regs[dst->reg], values, SIMD_LANES);
+            } else {
+                if(dst->value >= GEN_MEM_CAPACITY) {
+                    return 0;
+                }
+                for(uint32_t l = 0; l < group->lane_count; ++l) {
+                    if(group->is_active[l]) {
+                        group->machines[l]->general_memory[dst->value] = values[l];
+                    }
+                }
+                group->memory_writes++;
+            }
+            group->pc++;
+            return 1;
+        }
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL: {
+            if(instruction->is_invalid) {
+                return 0;
+            }
+            get_values(group, &instruction->src, values);
+            uint8_t* reg = group->regs[dst->reg];
+            if(instruction->op == OP_ADD) {
+                for(uint32_t l = 0; l < SIMD_LANES; ++l) {
+                    reg[l] += values[l];
+                }
+            } else if(instruction->op == OP_SUB) {
+                for(uint32_t l = 0; l < SIMD_LANES; ++l) {
+                    reg[l] -= values[l];
+                }
+            } else {
+                for(uint32_t l = 0; l < SIMD_LANES; ++l) {
+                    reg[l] *= values[l];
+                }
+            }
+            group->pc++;
+            return 1;
+        }
+        case OP_DIV: {
+            if(instruction->is_invalid) {
+                return 0;
+            }
+            get_values(group, &instruction->src, values);
+            // lanes dividing by zero fault, let the scalar engine report it
+            for(uint32_t l = 0; l < group->lane_count; ++l) {
+                if(group->is_active[l] && values[l] == 0) {
+                    peel_lane(group, l, program, n_instructions, reasons);
+                }
+            }
+            if(group->active_count == 0) {
+                return 0;
+            }
+            uint8_t* reg = group->regs[dst->reg];
+            for(uint32_t l = 0; l < SIMD_LANES; ++l) {
+                reg[l] /= values[l] ? values[l] : 1;
+            }
+            group->pc++;
+            return 1;
+        }
+        case OP_CMP: {
+            if(dst->kind == OPERAND_REG && instruction->src.kind == OPERAND_REG && dst->reg != instruction->src.reg) {
+                const uint8_t* reg_1 = group->regs[dst->reg];
+                const uint8_t* reg_2 = group->regs[instruction->src.reg];
+                for(uint32_t l = 0; l < SIMD_LANES; ++l) {
+                    group->fl[l] = reg_1[l] == reg_2[l] ? 1 : group->fl[l];
+                }
+            }
+            group->pc++;
+            return 1;
+        }
+        case OP_JMP: {
+            group->branches++;
+            group->pc = dst->value;
+            return 1;
+        }
+        case OP_JZ: {
+            uint32_t taken = 0;
+            for(uint32_t l = 0; l < group->lane_count; ++l) {
+                taken += group->is_active[l] && group->fl[l] != 0;
+            }
+            // the group follows the majority, the other lanes leave it
+            int is_taken = taken * 2 >= group->active_count;
+            if(taken != 0 && taken != group->active_count) {
+                for(uint32_t l = 0; l < group->lane_count; ++l) {
+                    if(group->is_active[l] && (group->fl[l] != 0) != is_taken) {
+                        peel_lane(group, l, program, n_instructions, reasons);
+                    }
+                }
+            }
+            group->branches++;
+            group->pc = is_taken ? (uint8_t)dst->value : group->pc + 1;
+            return 1;
+        }
+        case OP_PUSH:
+        case OP_POP: {
+            if(instruction->is_invalid) {
+                return 0;
+            }
+            // lanes that would overflow or underflow their stack fault, let the scalar engine report it
+            for(uint32_t l = 0; l < group->lane_count; ++l) {
+                if(group->is_active[l] && (instruction->op == OP_PUSH ? group->machines[l]->sp >= STACK_DEPTH : group->machines[l]->sp == 0)) {
+                    peel_lane(group, l, program, n_instructions, reasons);
+                }
+            }
+            if(group->active_count == 0) {
+                return 0;
+            }
+            // the stack is per lane, run the stack helpers on each lane's machine
+            uint8_t* reg = group->regs[dst->reg];
+            for(uint32_t l = 0; l < group->lane_count; ++l) {
+                if(!group->is_active[l]) {
+                    continue;
+                }
+                machine_t* machine = group->machines[l];
+                if(instruction->op == OP_PUSH) {
+                    set_reg(machine, dst->reg, reg[l]);
+                    push_stack(machine, dst->reg);
+                } else {
+                    pop_stack(machine, dst->reg);
+                    reg[l] = get_reg(machine, dst->reg);
+                }
+            }
+            group->pc++;
+            return 1;
+        }
+        case OP_FILL:
+        case OP_COPY:
+        case OP_MCMP: {
+            if(instruction->is_invalid) {
+                return 0;
+            }
+            const operand_t* src = &instruction->src;
+            const operand_t* extra = &instruction->extra;
+            // lanes whose range is out of memory fault, let the scalar engine report it
+            for(uint32_t l = 0; l < group->lane_count; ++l) {
+                if(!group->is_active[l]) {
+                    continue;
+                }
+                int is_valid = instruction->op == OP_FILL
+                    ? is_valid_range(dst->value, get_lane_value(group, src, l))
+                    : is_valid_range(dst->value, get_lane_value(group, extra, l)) && is_valid_range(src->value, get_lane_value(group, extra, l));
+                if(!is_valid) {
+                    peel_lane(group, l, program, n_instructions, reasons);
+                }
+            }
+            if(group->active_count == 0) {
+                return 0;
+            }
+            // memory is per lane, the block helpers count its reads, writes and cycles
+            for(uint32_t l = 0; l < group->lane_count; ++l) {
+                if(!group->is_active[l]) {
+                    continue;
+                }
+                machine_t* machine = group->machines[l];
+                if(instruction->op == OP_FILL) {
+                    fill_memory(machine, dst->value, get_lane_value(group, src, l), get_lane_value(group, extra, l));
+                } else if(instruction->op == OP_COPY) {
+                    copy_memory(machine, dst->value, src->value, get_lane_value(group, extra, l));
+                } else {
+                    compare_memory(machine, dst->value, src->value, get_lane_value(group, extra, l));
+                    group->fl[l] = machine->fl;
+                }
+            }
+            group->pc++;
+            return 1;
+        }
+        case OP_LEA: {
+            if(instruction->is_invalid || instruction->src.value >= GEN_MEM_CAPACITY) {
+                return 0;
+            }
+            memset(group->regs[dst->reg], instruction->src.value >> 8, SIMD_LANES);
+            memset(group->regs[dst->reg_lo], instruction->src.value & 0xff, SIMD_LANES);
+            group->pc++;
+            return 1;
+        }
+        case OP_NOP: {
+            group->pc++;
+            return 1;
+        }
+        default: return 0;
+    }
+}
+
+static void run_group(simd_group_t* group, const program_t* program, uint64_t n_instructions, STOP_REASON* reasons) {
+    while(group->active_count > 0 && group->executed < n_instructions && group->pc < program->length) {
+        const instruction_t* instruction = &program->instructions[group->pc];
+        if(!execute_lockstep(group, instruction, program, n_instructions, reasons)) {
+            break;
+        }
+        group->executed++;
+        group->cycles += cycle_costs[instruction->op];
+    }
+
+    // whatever is left continues on the scalar engine, which also reports halts, budget and faults
+    for(uint32_t l = 0; l < group->lane_count; ++l) {
+        if(group->is_active[l]) {
+            peel_lane(group, l, program, n_instructions, reasons);
+        }
+    }
+}
+
+void run_simd(machine_t** machines, uint32_t n, const program_t* program, uint64_t n_instructions, STOP_REASON* reasons) {
+    for(uint32_t base = 0; base < n; base += SIMD_LANES) {
+        simd_group_t group;
+        memset(&group, 0, sizeof(group));
+        group.lane_count = n - base < SIMD_LANES ? n - base : SIMD_LANES;
+        group.pc = machines[base]->pc;
+
+        for(uint32_t l = 0; l < group.lane_count; ++l) {
+            machine_t* machine = machines[base + l];
+            group.machines[l] = machine;
+            // lanes that can't start together, and verbose machines, which print every step, run alone
+            if(machine->halt || machine->pc != group.pc || machine->is_verbose) {
+                reasons[base + l] = run_decoded(machine, program, n_instructions);
+                continue;
+            }
+            group.regs[ax][l] = machine->ax;
+            group.regs[bx][l] = machine->bx;
+            group.regs[cx][l] = machine->cx;
+            group.regs[dx][l] = machine->dx;
+            group.fl[l] = machine->fl;
+            group.is_active[l] = 1;
+            group.active_count++;
+        }
+
+        run_group(&group, program, n_instructions, reasons + base);
+    }
+}
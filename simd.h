@@ -0,0 +1,51 @@
+/*
+
+    simd.h - Lockstep execution of many machines
+
+    run_simd() runs up to SIMD_LANES machines through the same decoded program at
+    once. The registers of a group are kept as arrays across machines (all ax values
+    next to each other, all bx values, ...), so every instruction is applied to the
+    whole group with loops the compiler turns into vector instructions. Memory and
+    the stack stay in the per-lane machine_t: [hi:lo] loads and stores compute the
+    addresses as a group and access each lane's memory, push/pop and the block
+    memory instructions run the scalar helpers lane by lane without leaving the group.
+
+    Lanes leave the group and continue on run_decoded() when:
+        - a jz goes the other way for them than for the majority of the group
+        - a div would divide by zero in that lane
+        - a block memory instruction would fault on that lane's range
+        - a push or pop would overflow or underflow that lane's stack
+    The whole group falls back to run_decoded() at hlt/end and at instructions with
+    invalid arguments, so the results are always those of the scalar engine.
+
+*/
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+#include "machine.h"
+#include "decode.h"
+
+#define SIMD_LANES 32
+
+typedef struct simd_group {
+    // registers of lane l are ax..dx: regs[reg][l], fl: fl[l]
+    _Alignas(64) uint8_t regs[4][SIMD_LANES];
+    _Alignas(64) uint8_t fl[SIMD_LANES];
+    uint8_t is_active[SIMD_LANES];
+    machine_t* machines[SIMD_LANES];
+    uint32_t lane_count;
+    uint32_t active_count;
+    uint8_t pc;
+
+    // counted once for the group, added to every lane when it leaves
+    uint64_t executed;
+    uint64_t cycles;
+    uint64_t branches;
+    uint64_t memory_reads;
+    uint64_t memory_writes;
+} simd_group_t;
+
+void run_simd(machine_t** machines, uint32_t n, const program_t* program, uint64_t n_instructions, STOP_REASON* reasons);
+
+#endif
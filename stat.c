@@ -0,0 +1,106 @@
+/*
+    stat.c - Attach to a running emulator (main -M) and print its live statistics
+
+    Usage: kystat <pid> [interval ms]
+
+    Stops when the emulator finishes, when the process is gone (a killed emulator
+    leaves its segment behind, kystat removes it) or when it hasn't published for
+    STATS_STALE_MS.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+#ifdef __unix__
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define DEFAULT_INTERVAL_MS 1000
+// paced emulators publish at least once per PACING_BURST_NS of emulated time, allow very slow clocks
+#define STATS_STALE_MS 60000
+
+#ifdef __unix__
+static uint64_t get_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+int main(int argc, char** argv) {
+#ifdef __unix__
+    if(argc < 2 || strcmp(argv[1], "-h") == 0) {
+        fprintf(stdout, "Usage: kystat <pid> [interval ms]\n");
+        return argc < 2 ? -1 : 0;
+    }
+
+    long pid = atol(argv[1]);
+    long interval_ms = argc > 2 ? atol(argv[2]) : DEFAULT_INTERVAL_MS;
+    if(interval_ms <= 0) {
+        interval_ms = DEFAULT_INTERVAL_MS;
+    }
+
+    char name[STATS_NAME_LEN];
+    get_stats_segment_name(name, pid);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if(fd == -1) {
+        fprintf(stderr, "[-] - no statistics for pid %ld, was it started with -M?\n", pid);
+        return -1;
+    }
+
+    const stats_segment_t* segment = mmap(NULL, sizeof(stats_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(segment == MAP_FAILED) {
+        fprintf(stderr, "[-] - cannot map %s\n", name);
+        return -1;
+    }
+    if(segment->magic != STATS_MAGIC || segment->version != STATS_VERSION) {
+        fprintf(stderr, "[-] - %s is not a statistics segment of this version\n", name);
+        return -1;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    fprintf(stdout, "%14s %12s %12s %12s %12s %6s %8s\n", "instructions", "instr/s", "branches", "mem reads", "mem writes", "stack", "errors");
+    while(1) {
+        uint32_t is_running = atomic_load(&segment->is_running);
+        fprintf(stdout, "%14llu %12llu %12llu %12llu %12llu %6llu %8llu\n",
+            (unsigned long long)atomic_load_explicit(&segment->instructions, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&segment->instructions_per_sec, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&segment->branches, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&segment->memory_reads, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&segment->memory_writes, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&segment->stack_high_water, memory_order_relaxed),
+            (unsigned long long)atomic_load_explicit(&segment->errors, memory_order_relaxed));
+        fflush(stdout);
+        if(!is_running) {
+            fprintf(stdout, "process %ld finished\n", pid);
+            break;
+        }
+
+        if(kill(pid, 0) != 0 && errno == ESRCH) {
+            fprintf(stdout, "process %ld is gone, removing %s\n", pid, name);
+            shm_unlink(name);
+            break;
+        }
+        // publish time is CLOCK_MONOTONIC, shared by all processes; 0 until the first publish
+        uint64_t publish_time_ns = atomic_load_explicit(&segment->publish_time_ns, memory_order_relaxed);
+        if(publish_time_ns != 0 && get_now_ns() - publish_time_ns > STATS_STALE_MS * 1000000ull) {
+            fprintf(stdout, "process %ld stopped publishing\n", pid);
+            break;
+        }
+        usleep(interval_ms * 1000);
+    }
+
+    munmap((void*)segment, sizeof(stats_segment_t));
+    return 0;
+#else
+    fprintf(stderr, "[-] - shared memory statistics are not supported on this system\n");
+    return -1;
+#endif
+}
@@ -0,0 +1,68 @@
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef __unix__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+void get_stats_segment_name(char* name, long pid) {
+    snprintf(name, STATS_NAME_LEN, "/kyemu.%ld", pid);
+}
+
+stats_segment_t* open_stats_segment(const char* name) {
+#ifdef __unix__
+    if(strlen(name) >= STATS_NAME_LEN) {
+        fprintf(stderr, "[-] open_stats_segment() : segment name too long\n");
+        return NULL;
+    }
+
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if(fd == -1) {
+        fprintf(stderr, "[-] open_stats_segment() : cannot create shared memory segment %s\n", name);
+        return NULL;
+    }
+    if(ftruncate(fd, sizeof(stats_segment_t)) != 0) {
+        fprintf(stderr, "[-] open_stats_segment() : cannot size shared memory segment %s\n", name);
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    stats_segment_t* segment = mmap(NULL, sizeof(stats_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(segment == MAP_FAILED) {
+        fprintf(stderr, "[-] open_stats_segment() : cannot map shared memory segment %s\n", name);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    memset(segment, 0, sizeof(stats_segment_t));
+    segment->version = STATS_VERSION;
+    strcpy(segment->name, name);
+    atomic_store(&segment->is_running, 1);
+    // readers check the magic last, so only a fully initialized segment is accepted
+    atomic_thread_fence(memory_order_release);
+    segment->magic = STATS_MAGIC;
+    return segment;
+#else
+    fprintf(stderr, "[-] open_stats_segment() : shared memory statistics are not supported on this system\n");
+    return NULL;
+#endif
+}
+
+void close_stats_segment(stats_segment_t* segment) {
+#ifdef __unix__
+    if(segment == NULL) {
+        return;
+    }
+    char name[STATS_NAME_LEN];
+    strcpy(name, segment->name);
+
+    atomic_store(&segment->is_running, 0);
+    munmap(segment, sizeof(stats_segment_t));
+    shm_unlink(name);
+#endif
+}
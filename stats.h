@@ -0,0 +1,56 @@
+/*
+
+    stats.h - Live machine statistics
+
+    The interpreter counts into plain per-machine counters (machine_stats_t) and
+    every STATS_PUBLISH_INTERVAL instructions copies them into a shared memory
+    segment with relaxed atomic stores, so a running emulator can be watched from
+    another process (see stat.c) without taking locks on the hot path.
+
+    Segment name: /kyemu.<pid> for the main executable, any name for embedders
+    Shared memory export is only available on unix systems.
+
+*/
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define STATS_MAGIC 0x5453594b
+#define STATS_VERSION 2
+#define STATS_NAME_LEN 32
+// must be a power of 2
+#define STATS_PUBLISH_INTERVAL 4096
+// instructions_per_sec is measured over at least this long
+#define STATS_RATE_WINDOW_NS 100000000ull
+
+typedef struct machine_stats {
+    uint64_t instructions;
+    uint64_t branches;
+    uint64_t memory_reads;
+    uint64_t memory_writes;
+    uint64_t stack_high_water;
+} machine_stats_t;
+
+typedef struct stats_segment {
+    uint32_t magic;
+    uint32_t version;
+    char name[STATS_NAME_LEN];
+    _Atomic uint32_t is_running;
+    _Atomic uint64_t instructions;
+    _Atomic uint64_t instructions_per_sec;
+    _Atomic uint64_t branches;
+    _Atomic uint64_t memory_reads;
+    _Atomic uint64_t memory_writes;
+    _Atomic uint64_t stack_high_water;
+    _Atomic uint64_t errors;
+    _Atomic uint64_t publish_time_ns;
+} stats_segment_t;
+
+void get_stats_segment_name(char* name, long pid);
+stats_segment_t* open_stats_segment(const char* name);
+void close_stats_segment(stats_segment_t* segment);
+
+#endif
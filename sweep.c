@@ -0,0 +1,412 @@
+#include "sweep.h"
+
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+static const char* stop_names[] = { "halted", "budget", "fault" };
+
+typedef struct sweep_job {
+    const sweep_t* sweep;
+    sweep_result_t* results;
+    // range_bytes per row, collected memory ranges
+    uint8_t* memory;
+    uint32_t range_bytes;
+    _Atomic uint32_t next_row;
+    _Atomic uint32_t err_counter;
+} sweep_job_t;
+
+static uint32_t parse_column(sweep_column_t* column, const char* name) {
+    static const char* reg_names[] = { "ax", "bx", "cx", "dx", "sp", "bp", "pc", "fl" };
+
+    if(name[0] == '%') {
+        char* end;
+        long addr = strtol(name + 1, &end, 0);
+        if(*end != 0 || end == name + 1 || addr < 0 || addr >= GEN_MEM_CAPACITY) {
+            return 1;
+        }
+        column->is_memory = 1;
+        column->addr = addr;
+        return 0;
+    }
+    for(uint32_t i = 0; i < 8; ++i) {
+        if(strcmp(name, reg_names[i]) == 0) {
+            column->is_memory = 0;
+            column->reg = i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// split on commas in place and trim the fields
+static uint32_t split_fields(char* line, char** fields, uint32_t max_fields) {
+    uint32_t n = 0;
+    char* c = line;
+    while(n < max_fields) {
+        while(*c == ' ' || *c == '\t') {
+            ++c;
+        }
+        fields[n++] = c;
+        char* sep = c + strcspn(c, ",");
+        char* end = sep;
+        while(end > c && (end[-1] == ' ' || end[-1] == '\t')) {
+            --end;
+        }
+        if(*sep == 0) {
+            *end = 0;
+            break;
+        }
+        *end = 0;
+        c = sep + 1;
+    }
+    return n;
+}
+
+static uint32_t add_row(sweep_inputs_t* inputs, uint32_t* capacity) {
+    if(inputs->row_count == *capacity) {
+        uint32_t new_capacity = *capacity ? *capacity * 2 : 1024;
+        uint8_t* values = realloc(inputs->values, (size_t)new_capacity * inputs->column_count);
+        if(values == NULL) {
+            return 1;
+        }
+        inputs->values = values;
+        *capacity = new_capacity;
+    }
+    inputs->row_count++;
+    return 0;
+}
+
+static uint32_t load_csv_inputs(sweep_inputs_t* inputs, FILE* fp, const char* path) {
+    char buf[MAX_LINE_LEN];
+    char* fields[MAX_SWEEP_COLUMNS + 1];
+    uint32_t capacity = 0;
+    uint32_t ln = 0;
+
+    while(fgets(buf, MAX_LINE_LEN, fp)) {
+        ++ln;
+        buf[strcspn(buf, "\r\n")] = 0;
+        if(buf[strspn(buf, " \t")] == 0) {
+            continue;
+        }
+        uint32_t n = split_fields(buf, fields, MAX_SWEEP_COLUMNS + 1);
+
+        if(inputs->column_count == 0) {
+            if(n > MAX_SWEEP_COLUMNS) {
+                fprintf(stderr, "[-] load_sweep_inputs() : %s:%u: too many columns (max. %d)\n", path, ln, MAX_SWEEP_COLUMNS);
+                return 1;
+            }
+            for(uint32_t i = 0; i < n; ++i) {
+                if(parse_column(&inputs->columns[i], fields[i]) != 0) {
+                    fprintf(stderr, "[-] load_sweep_inputs() : %s:%u: invalid column `%s`\n", path, ln, fields[i]);
+                    return 1;
+                }
+            }
+            inputs->column_count = n;
+            continue;
+        }
+
+        if(n != inputs->column_count) {
+            fprintf(stderr, "[-] load_sweep_inputs() : %s:%u: expected %u values\n", path, ln, inputs->column_count);
+            return 1;
+        }
+        if(add_row(inputs, &capacity) != 0) {
+            fprintf(stderr, "[-] load_sweep_inputs() : out of memory\n");
+            return 1;
+        }
+        uint8_t* row = inputs->values + (size_t)(inputs->row_count - 1) * inputs->column_count;
+        for(uint32_t i = 0; i < n; ++i) {
+            char* end;
+            long value = strtol(fields[i], &end, 0);
+            if(*end != 0 || end == fields[i] || value < 0 || value > UINT8_MAX) {
+                fprintf(stderr, "[-] load_sweep_inputs() : %s:%u: invalid value `%s`\n", path, ln, fields[i]);
+                return 1;
+            }
+            row[i] = value;
+        }
+    }
+
+    if(inputs->column_count == 0) {
+        fprintf(stderr, "[-] load_sweep_inputs() : %s: missing column header\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+static uint32_t read_u32(FILE* fp, uint32_t* value) {
+    uint8_t b[4];
+    if(fread(b, 1, 4, fp) != 4) {
+        return 1;
+    }
+    *value = b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24;
+    return 0;
+}
+
+static uint32_t load_binary_inputs(sweep_inputs_t* inputs, FILE* fp, const char* path) {
+    uint32_t column_count, row_count;
+    if(read_u32(fp, &column_count) != 0 || column_count == 0 || column_count > MAX_SWEEP_COLUMNS) {
+        fprintf(stderr, "[-] load_sweep_inputs() : %s: invalid column count\n", path);
+        return 1;
+    }
+    for(uint32_t i = 0; i < column_count; ++i) {
+        uint8_t b[4];
+        sweep_column_t* column = &inputs->columns[i];
+        if(fread(b, 1, 4, fp) != 4 || b[0] > 1 || (b[0] == 0 && b[1] > fl)) {
+            fprintf(stderr, "[-] load_sweep_inputs() : %s: invalid column %u\n", path, i);
+            return 1;
+        }
+        column->is_memory = b[0];
+        column->reg = b[1];
+        column->addr = b[2] | b[3] << 8;
+    }
+    inputs->column_count = column_count;
+
+    if(read_u32(fp, &row_count) != 0) {
+        fprintf(stderr, "[-] load_sweep_inputs() : %s: missing row count\n", path);
+        return 1;
+    }
+    size_t size = (size_t)row_count * column_count;
+    inputs->values = malloc(size ? size : 1);
+    if(inputs->values == NULL) {
+        fprintf(stderr, "[-] load_sweep_inputs() : out of memory\n");
+        return 1;
+    }
+    if(fread(inputs->values, 1, size, fp) != size) {
+        fprintf(stderr, "[-] load_sweep_inputs() : %s: expected %u rows\n", path, row_count);
+        return 1;
+    }
+    inputs->row_count = row_count;
+    return 0;
+}
+
+uint32_t load_sweep_inputs(sweep_inputs_t* inputs, const char* path) {
+    memset(inputs, 0, sizeof(sweep_inputs_t));
+
+    FILE* fp = fopen(path, "rb");
+    if(fp == NULL) {
+        fprintf(stderr, "[-] load_sweep_inputs() : cannot open input table %s\n", path);
+        return 1;
+    }
+
+    char magic[4];
+    uint32_t err_counter;
+    if(fread(magic, 1, 4, fp) == 4 && memcmp(magic, SWEEP_BINARY_MAGIC, 4) == 0) {
+        err_counter = load_binary_inputs(inputs, fp, path);
+    } else {
+        rewind(fp);
+        err_counter = load_csv_inputs(inputs, fp, path);
+    }
+    fclose(fp);
+
+    if(err_counter != 0) {
+        free_sweep_inputs(inputs);
+    }
+    return err_counter;
+}
+
+void free_sweep_inputs(sweep_inputs_t* inputs) {
+    free(inputs->values);
+    inputs->values = NULL;
+    inputs->row_count = 0;
+}
+
+uint32_t parse_sweep_range(sweep_range_t* range, const char* text) {
+    char* end;
+    if(text[0] != '%') {
+        return 1;
+    }
+    long addr = strtol(text + 1, &end, 0);
+    if(*end != ':' || end == text + 1) {
+        return 1;
+    }
+    const char* len_text = end + 1;
+    long len = strtol(len_text, &end, 0);
+    if(*end != 0 || end == len_text || addr < 0 || len <= 0 || addr + len > GEN_MEM_CAPACITY) {
+        return 1;
+    }
+    range->addr = addr;
+    range->len = len;
+    return 0;
+}
+
+// faults are part of the result, don't print thousands of them
+static int count_fault(machine_t* machine, uint32_t pc, const char* message, void* user_data) {
+    return 0;
+}
+
+static void seed_machine(machine_t* machine, const sweep_inputs_t* inputs, const uint8_t* row) {
+    reset(machine);
+    for(uint32_t i = 0; i < inputs->column_count; ++i) {
+        const sweep_column_t* column = &inputs->columns[i];
+        if(column->is_memory) {
+            machine->general_memory[column->addr] = row[i];
+        } else {
+            set_reg(machine, column->reg, row[i]);
+        }
+    }
+}
+
+static void collect_result(const machine_t* machine, const sweep_t* sweep, STOP_REASON reason, sweep_result_t* result, uint8_t* memory) {
+    result->ax = machine->ax;
+    result->bx = machine->bx;
+    result->cx = machine->cx;
+    result->dx = machine->dx;
+    result->fl = machine->fl;
+    result->stop = reason;
+    result->err_counter = machine->err_counter;
+    result->instructions = machine->stats.instructions;
+
+    for(uint32_t i = 0; i < sweep->range_count; ++i) {
+        memcpy(memory, machine->general_memory + sweep->ranges[i].addr, sweep->ranges[i].len);
+        memory += sweep->ranges[i].len;
+    }
+}
+
+static void* sweep_worker(void* arg) {
+    sweep_job_t* job = (sweep_job_t*)arg;
+    const sweep_t* sweep = job->sweep;
+    const sweep_inputs_t* inputs = sweep->inputs;
+
+    // machines are created once per worker and reused for every row it runs
+    machine_t* machines[SIMD_LANES];
+    STOP_REASON reasons[SIMD_LANES];
+    uint32_t n_machines = sweep->engine == SWEEP_ENGINE_SIMD ? SIMD_LANES : 1;
+    for(uint32_t i = 0; i < n_machines; ++i) {
+        machines[i] = create_machine();
+        if(machines[i] == NULL) {
+            atomic_fetch_add(&job->err_counter, 1);
+            for(uint32_t j = 0; j < i; ++j) {
+                destroy_machine(machines[j]);
+            }
+            return NULL;
+        }
+        set_fault_callback(machines[i], count_fault, NULL);
+    }
+
+    while(1) {
+        uint32_t first = atomic_fetch_add(&job->next_row, SWEEP_CHUNK_ROWS);
+        if(first >= inputs->row_count) {
+            break;
+        }
+        uint32_t last = first + SWEEP_CHUNK_ROWS < inputs->row_count ? first + SWEEP_CHUNK_ROWS : inputs->row_count;
+
+        for(uint32_t row = first; row < last; row += n_machines) {
+            uint32_t n = last - row < n_machines ? last - row : n_machines;
+            for(uint32_t i = 0; i < n; ++i) {
+                seed_machine(machines[i], inputs, inputs->values + (size_t)(row + i) * inputs->column_count);
+            }
+
+            if(sweep->engine == SWEEP_ENGINE_SIMD) {
+                run_simd(machines, n, sweep->program, sweep->max_instructions, reasons);
+            } else {
+                reasons[0] = run_decoded(machines[0], sweep->program, sweep->max_instructions);
+            }
+
+            for(uint32_t i = 0; i < n; ++i) {
+                collect_result(machines[i], sweep, reasons[i], &job->results[row + i], job->memory + (size_t)(row + i) * job->range_bytes);
+            }
+        }
+    }
+
+    for(uint32_t i = 0; i < n_machines; ++i) {
+        destroy_machine(machines[i]);
+    }
+    return NULL;
+}
+
+static uint32_t write_results(const sweep_job_t* job, const char* results_path) {
+    const sweep_t* sweep = job->sweep;
+
+    FILE* fp = fopen(results_path, "w");
+    if(fp == NULL) {
+        fprintf(stderr, "[-] run_sweep() : cannot open results file %s\n", results_path);
+        return 1;
+    }
+
+    fprintf(fp, "row,ax,bx,cx,dx,fl,errors,stop,instructions");
+    for(uint32_t i = 0; i < sweep->range_count; ++i) {
+        fprintf(fp, ",%%%u:%u", sweep->ranges[i].addr, sweep->ranges[i].len);
+    }
+    fprintf(fp, "\n");
+
+    for(uint32_t row = 0; row < sweep->inputs->row_count; ++row) {
+        const sweep_result_t* result = &job->results[row];
+        fprintf(fp, "%u,%u,%u,%u,%u,%u,%u,%s,%llu", row, result->ax, result->bx, result->cx, result->dx, result->fl,
+            result->err_counter, stop_names[result->stop], (unsigned long long)result->instructions);
+
+        const uint8_t* memory = job->memory + (size_t)row * job->range_bytes;
+        for(uint32_t i = 0; i < sweep->range_count; ++i) {
+            fputc(',', fp);
+            for(uint32_t j = 0; j < sweep->ranges[i].len; ++j) {
+                fprintf(fp, "%02x", *memory++);
+            }
+        }
+        fputc('\n', fp);
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+uint32_t run_sweep(const sweep_t* sweep, const char* results_path) {
+    uint32_t row_count = sweep->inputs->row_count;
+
+    sweep_job_t job;
+    job.sweep = sweep;
+    job.range_bytes = 0;
+    for(uint32_t i = 0; i < sweep->range_count; ++i) {
+        job.range_bytes += sweep->ranges[i].len;
+    }
+    job.results = calloc(row_count ? row_count : 1, sizeof(sweep_result_t));
+    job.memory = malloc((size_t)row_count * job.range_bytes + 1);
+    atomic_init(&job.next_row, 0);
+    atomic_init(&job.err_counter, 0);
+    if(job.results == NULL || job.memory == NULL) {
+        fprintf(stderr, "[-] run_sweep() : out of memory\n");
+        free(job.results);
+        free(job.memory);
+        return 1;
+    }
+
+    uint32_t n_threads = sweep->n_threads ? sweep->n_threads : get_core_count();
+    if(n_threads > MAX_SWEEP_THREADS) {
+        n_threads = MAX_SWEEP_THREADS;
+    }
+    if(n_threads > (row_count + SWEEP_CHUNK_ROWS - 1) / SWEEP_CHUNK_ROWS) {
+        n_threads = (row_count + SWEEP_CHUNK_ROWS - 1) / SWEEP_CHUNK_ROWS;
+    }
+
+    uint64_t start_ns = get_time_ns();
+
+    pthread_t threads[MAX_SWEEP_THREADS];
+    uint32_t started = 0;
+    // the calling thread is a worker too
+    while(started + 1 < n_threads) {
+        if(pthread_create(&threads[started], NULL, sweep_worker, &job) != 0) {
+            break;
+        }
+        ++started;
+    }
+    sweep_worker(&job);
+    for(uint32_t i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    uint64_t elapsed_ns = get_time_ns() - start_ns;
+    uint64_t instructions = 0;
+    for(uint32_t row = 0; row < row_count; ++row) {
+        instructions += job.results[row].instructions;
+    }
+    printf("SWEEP: %u rows on %u threads in %.3f ms (%.0f rows/s, %.0f instructions/s)\n",
+        row_count, started + 1, elapsed_ns / 1e6,
+        elapsed_ns ? row_count * 1e9 / elapsed_ns : 0.0, elapsed_ns ? instructions * 1e9 / elapsed_ns : 0.0);
+
+    uint32_t err_counter = atomic_load(&job.err_counter);
+    if(err_counter == 0) {
+        err_counter = write_results(&job, results_path);
+    }
+
+    free(job.results);
+    free(job.memory);
+    return err_counter;
+}
@@ -0,0 +1,85 @@
+/*
+
+    sweep.h - Parameter sweeps
+
+    Runs one program over every row of an input table, in parallel. The program is
+    decoded once and shared read-only by all worker threads, every worker owns one
+    machine (SIMD_LANES with the simd engine) which is reset and seeded from the next
+    row(s) of the table.
+
+    Input table, CSV:
+        the first line names the columns: ax, bx, cx, dx, sp, bp, pc, fl or %N for
+        the memory address N, every further line holds one value (0-255) per column
+    Input table, binary (little endian):
+        "KYSW", uint32 column count,
+        per column: uint8 kind (0 register, 1 memory), uint8 register (REGS), uint16 address,
+        uint32 row count, then row count * column count value bytes, row by row
+
+    Results, CSV, one line per input row, in input order:
+        row,ax,bx,cx,dx,fl,errors,stop,instructions[,%N:len...]
+        stop is halted, budget or fault, memory ranges are written as hex bytes
+
+*/
+
+#ifndef SWEEP_H_
+#define SWEEP_H_
+
+#include "machine.h"
+#include "decode.h"
+#include "simd.h"
+
+#define MAX_SWEEP_COLUMNS 64
+#define MAX_SWEEP_RANGES 16
+#define MAX_SWEEP_THREADS 64
+// rows a worker takes from the table at once, a multiple of SIMD_LANES
+#define SWEEP_CHUNK_ROWS 64
+#define SWEEP_BINARY_MAGIC "KYSW"
+
+typedef enum SWEEP_ENGINE {
+    SWEEP_ENGINE_DECODED,   // run_decoded(), one machine at a time
+    SWEEP_ENGINE_SIMD       // run_simd(), SIMD_LANES machines in lockstep
+} SWEEP_ENGINE;
+
+typedef struct sweep_column {
+    uint8_t is_memory;
+    uint8_t reg;
+    uint32_t addr;
+} sweep_column_t;
+
+typedef struct sweep_range {
+    uint32_t addr;
+    uint32_t len;
+} sweep_range_t;
+
+typedef struct sweep_inputs {
+    sweep_column_t columns[MAX_SWEEP_COLUMNS];
+    uint32_t column_count;
+    // row_count * column_count values, row by row
+    uint8_t* values;
+    uint32_t row_count;
+} sweep_inputs_t;
+
+typedef struct sweep {
+    const program_t* program;
+    const sweep_inputs_t* inputs;
+    sweep_range_t ranges[MAX_SWEEP_RANGES];
+    uint32_t range_count;
+    // instruction budget of a single run, cuts off programs that never halt
+    uint64_t max_instructions;
+    uint32_t n_threads;
+    SWEEP_ENGINE engine;
+} sweep_t;
+
+typedef struct sweep_result {
+    uint8_t ax, bx, cx, dx, fl;
+    uint8_t stop;
+    uint32_t err_counter;
+    uint64_t instructions;
+} sweep_result_t;
+
+uint32_t load_sweep_inputs(sweep_inputs_t* inputs, const char* path);
+void free_sweep_inputs(sweep_inputs_t* inputs);
+uint32_t parse_sweep_range(sweep_range_t* range, const char* text);
+uint32_t run_sweep(const sweep_t* sweep, const char* results_path);
+
+#endif